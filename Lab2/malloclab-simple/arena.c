@@ -0,0 +1,166 @@
+/*
+ * arena.c - 区域分配器（见 arena.h）。
+ *
+ * 每个块的开头是 struct arena_chunk，块之间用 prev 串成从新到旧的链表；
+ * struct arena 本身放在第一个块的块头后面，所以 arena_create 只需要一次 mmap。
+ *
+ *   chunk: | struct arena_chunk | (第一个块: struct arena) | 已分配 ... | ptr -> 空闲 ... | end
+ *
+ * 分配只在最新的块（cur）里移动 ptr；放不下时换一个新块，旧块剩下的部分不再使用。
+ * 回到某个 mark 时，比 mark 新的块都还给系统，只留一个普通大小的块作为备用（spare），
+ * 这样每轮都回到同一个 mark 的循环不会反复 mmap/munmap。
+ */
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE (2 * 1024 * 1024)     // 默认块大小，2MB，和 mm.c 的 MAX_HEAP 一样
+#define ARENA_PAGE 4096
+
+#define ALIGN_UP(x, a) (((uintptr_t)(x) + (a) - 1) & ~(uintptr_t)((a) - 1))
+
+struct arena_chunk {
+    struct arena_chunk *prev;   // 更旧的一个块
+    char *end;                  // 块的结束地址
+};
+
+struct arena {
+    struct arena_chunk *cur;    // 最新的块，在这里分配
+    char *ptr;                  // cur 中第一个未使用的字节
+    struct arena_chunk *spare;  // 回退时留下的一个空块
+    size_t chunk_size;
+};
+
+#define CHUNK_HDR ALIGN_UP(sizeof(struct arena_chunk), ARENA_ALIGN)
+#define ARENA_HDR ALIGN_UP(sizeof(struct arena), ARENA_ALIGN)
+#define CHUNK_START(c) ((char *)(c) + CHUNK_HDR)
+
+/*
+ * chunk_map - mmap 一个至少能放下 size 字节（含块头）的块，失败返回 NULL
+ */
+static struct arena_chunk *chunk_map(size_t size, size_t chunk_size)
+{
+    size_t len;
+    struct arena_chunk *c;
+
+    if (size > SIZE_MAX - ARENA_PAGE)
+        return NULL;
+    len = ALIGN_UP(size, ARENA_PAGE);
+    if (len < chunk_size)
+        len = chunk_size;
+    c = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c == MAP_FAILED)
+        return NULL;
+    c->end = (char *)c + len;
+    return c;
+}
+
+static void chunk_unmap(struct arena_chunk *c)
+{
+    munmap(c, c->end - (char *)c);
+}
+
+/*
+ * chunk_push - 换一个至少能分配 size 字节的新块作为 cur，优先使用备用块
+ */
+static int chunk_push(struct arena *a, size_t size)
+{
+    struct arena_chunk *c;
+
+    if (size > SIZE_MAX - CHUNK_HDR)
+        return -1;
+    if (a->spare != NULL && size <= (size_t)(a->spare->end - CHUNK_START(a->spare))) {
+        c = a->spare;
+        a->spare = NULL;
+    } else if ((c = chunk_map(CHUNK_HDR + size, a->chunk_size)) == NULL) {
+        return -1;
+    }
+    c->prev = a->cur;
+    a->cur = c;
+    a->ptr = CHUNK_START(c);
+    return 0;
+}
+
+/*
+ * arena_create - 创建一个 arena，chunk_size 为每次 mmap 的块大小（0 表示默认的 2MB）
+ */
+struct arena *arena_create(size_t chunk_size)
+{
+    struct arena_chunk *c;
+    struct arena *a;
+
+    chunk_size = ALIGN_UP(chunk_size ? chunk_size : ARENA_CHUNK_SIZE, ARENA_PAGE);
+    if ((c = chunk_map(CHUNK_HDR + ARENA_HDR, chunk_size)) == NULL)
+        return NULL;
+    c->prev = NULL;
+    a = (struct arena *)CHUNK_START(c);
+    a->cur = c;
+    a->ptr = (char *)a + ARENA_HDR;
+    a->spare = NULL;
+    a->chunk_size = chunk_size;
+    return a;
+}
+
+/*
+ * arena_alloc - 分配 size 字节，按 ARENA_ALIGN 对齐。不能单独释放。
+ */
+void *arena_alloc(struct arena *a, size_t size)
+{
+    char *p = (char *)ALIGN_UP(a->ptr, ARENA_ALIGN);
+
+    if (size > (size_t)(a->cur->end - p)) {
+        if (chunk_push(a, size) < 0)
+            return NULL;
+        p = a->ptr;
+    }
+    a->ptr = p + size;
+    return p;
+}
+
+/*
+ * arena_mark - 记下当前的分配位置
+ */
+struct arena_mark arena_mark(struct arena *a)
+{
+    struct arena_mark m = { a->cur, a->ptr };
+
+    return m;
+}
+
+/*
+ * arena_reset_to_mark - 释放 mark 之后分配的所有内存。比 mark 新的块还给系统
+ *     （留一个作备用），mark 必须来自这个 arena，且没有被更早的回退作废。
+ */
+void arena_reset_to_mark(struct arena *a, struct arena_mark mark)
+{
+    struct arena_chunk *c;
+
+    while (a->cur != mark.chunk) {
+        c = a->cur;
+        a->cur = c->prev;
+        if (a->spare == NULL && (size_t)(c->end - (char *)c) == a->chunk_size) {
+            a->spare = c;
+        } else {
+            chunk_unmap(c);
+        }
+    }
+    a->ptr = mark.ptr;
+}
+
+/*
+ * arena_destroy - 释放 arena 的全部内存，包括 arena 本身
+ */
+void arena_destroy(struct arena *a)
+{
+    struct arena_chunk *c = a->cur, *prev;
+
+    if (a->spare != NULL)
+        chunk_unmap(a->spare);
+    // 第一个块里放着 *a，最后释放
+    for (; c != NULL; c = prev) {
+        prev = c->prev;
+        chunk_unmap(c);
+    }
+}
@@ -0,0 +1,41 @@
+# ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * arena - 区域分配器：在 mmap 得到的块（chunk）里移动指针分配，块用完了就再
+ * mmap 一块串在链表上。单个对象不能释放，只能通过 arena_reset_to_mark 回到
+ * 之前某个时刻，或者 arena_destroy 一次性全部释放。
+ *
+ *     struct arena *a = arena_create(0);
+ *     struct arena_mark m = arena_mark(a);
+ *     ... arena_alloc(a, n) ...
+ *     arena_reset_to_mark(a, m);      // 释放 m 之后分配的全部内存
+ *     arena_destroy(a);
+ */
+#define ARENA_ALIGN 16      /* arena_alloc 返回的地址按 16 字节对齐 */
+
+struct arena;
+
+/* arena_mark 记下的位置：当时的块和块内指针 */
+struct arena_mark {
+    void *chunk;
+    char *ptr;
+};
+
+extern struct arena *arena_create(size_t chunk_size);
+extern void *arena_alloc(struct arena *a, size_t size);
+extern struct arena_mark arena_mark(struct arena *a);
+extern void arena_reset_to_mark(struct arena *a, struct arena_mark mark);
+extern void arena_destroy(struct arena *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARENA_H__ */
@@ -1,5 +1,7 @@
 #include <stdio.h>
+#include <unistd.h>
 #include "mm.h"
+#include "arena.h"
 
 #define malloc(size) mm_malloc(size)
 #define free(ptr) mm_free(ptr)
@@ -39,5 +41,26 @@ int main() {
     mm_free(ptr2);
     mm_free(ptr3);
 
+    // Region allocation: everything after a mark is freed at once
+    struct arena *a = arena_create(0);
+    struct arena_mark m = arena_mark(a);
+    for (int round = 0; round < 2; round++) {
+        char *p1 = arena_alloc(a, 16);
+        char *p2 = arena_alloc(a, 100);
+        char *big = arena_alloc(a, 4 * 1024 * 1024);    // larger than a chunk
+        printf("Arena round %d: p1: %p p2: %p big: %p\n", round, p1, p2, big);
+        arena_reset_to_mark(a, m);
+    }
+    arena_destroy(a);
+
+    // Someone else moves brk between two allocations: the heap is no longer
+    // contiguous and the new block must fit in the new space on its own
+    char *before = mm_malloc(3 << 20);
+    sbrk(4096);
+    char *after = mm_malloc(4 << 20);
+    before[(3 << 20) - 1] = 1;
+    after[(4 << 20) - 1] = 1;
+    printf("After a foreign sbrk: %p (brk %p)\n", after, sbrk(0));
+
     return 0;
 }
@@ -1,6 +1,12 @@
 /*
  * mm.c - 一个最基础版本的内存分配器，通过 sbrk 预留堆空间，然后只分配，不回收。
  *        每次分配时都直接从当前未使用过的堆空间中分配，没有足够空间时，使用 sbrk 拓展固定大小的堆空间。
+ *
+ *        返回的地址按 16 字节对齐。SIZE_HDR=1 时在每个块前面放一个 8 字节的头部记录用户申请的大小，
+ *        这样 mm_free 能知道释放了多少，get_utilization() 就能像 malloclab 一样给出
+ *        user_malloc_size / heap_size（内存并不会被重用）：
+ *
+ *            | size | payload (16 字节对齐) ... | size | payload ... |
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,70 +14,110 @@
 #include <unistd.h>
 #include <string.h>
 
+#ifndef SIZE_HDR
+#define SIZE_HDR 0
+#endif
+
 #define MAX_HEAP (2 * 1024 * 1024) // 每次使用 sbrk 拓展的大小，2MB
+#define ALIGNMENT 16
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
+
+#if SIZE_HDR
+#define HDR_SIZE sizeof(size_t)                         // 头部大小，紧挨在 payload 前面
+#define HDRP(bp) ((size_t *)((char *)(bp) - HDR_SIZE))
+#else
+#define HDR_SIZE 0
+#endif
 
 static char *mem_start_brk;  // 当前堆的起始地址
 static char *mem_brk;        // 当前已经使用的堆空间的结束地址（或者说，当前未使用的堆空间的起始地址）
 static char *mem_max_addr;   // 当前已分配的堆的结束地址
 
+size_t user_malloc_size = 0; // 用户申请且尚未释放的字节数（SIZE_HDR=1 时统计）
+size_t heap_size = 0;        // 通过 sbrk 得到的字节数
+
 /* 
  * mm_init - 初始化内存分配器，通过 sbrk 先预留 MAX_HEAP 大小的内存空间
  */
 int mm_init(void)
 {
     mem_start_brk = (char*)sbrk(MAX_HEAP);
-    if (mem_start_brk == NULL) {
+    if (mem_start_brk == (char*)-1) {
         fprintf(stderr, "mem_init: sbrk failed\n");
         exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;    // 设置正确的结束地址
     mem_brk = mem_start_brk;                    // 开始未使用任何空间
+    heap_size = MAX_HEAP;
+    user_malloc_size = 0;
     return 0;
 }
 
 /* 
- * mm_malloc - 分配 size 字节的内存空间，
+ * mm_malloc - 分配 size 字节的内存空间，返回的地址按 ALIGNMENT 对齐
  */
 void *mm_malloc(size_t size)
 {
-    /*
-        TODO:
-        从当前未使用的堆空间（mem_brk开始的空间）中分配 size 字节的内存空间。
-        如果剩余空间不够，则使用 sbrk 拓展足够的空间（注意对齐）。
-    */
-    
-    long rest_size = mem_max_addr - mem_brk; // TODO: 修改该行，计算当前剩余的堆空间大小 （提示，使用全局变量）
+    // payload 对齐到 ALIGNMENT，头部（如果有）放在 payload 前面的对齐空隙里
+    char *bp = (char*)ALIGN((size_t)mem_brk + HDR_SIZE);
+    long rest_size = mem_max_addr - bp; // 当前剩余的堆空间大小
 
-    if (rest_size < size) {
+    if (rest_size < (long)size) {
         // 如果剩余空间不够，需要使用 sbrk 拓展
         long need_size = size - rest_size;  // 缺少的空间
         long need_size_aligned = (need_size + MAX_HEAP - 1) / MAX_HEAP * MAX_HEAP;  // 上取整到 MAX_HEAP 的倍数
+        char *old_brk = (char*)sbrk(need_size_aligned);
 
-        // TODO: 使用 sbrk 拓展堆 need_size_aligned 字节的空间，并更新 mem_max_addr
-        // ...
-        sbrk(need_size_aligned);
-        mem_max_addr = mem_max_addr + need_size_aligned;
+        if (old_brk == (char*)-1)
+            return NULL;
+        heap_size += need_size_aligned;
+        if (old_brk != mem_max_addr) {
+            // 别人（比如 libc 的 malloc）也移动过 brk，新空间和原来的堆不连续，从新空间的开头分配。
+            // 原来堆剩下的 rest_size 用不上了，新空间要能单独放下整个块（加上对齐和头部）
+            long full_size = (size + ALIGNMENT + HDR_SIZE + MAX_HEAP - 1) / MAX_HEAP * MAX_HEAP;
+            if (need_size_aligned < full_size) {
+                if (sbrk(full_size - need_size_aligned) == (void*)-1)
+                    return NULL;
+                heap_size += full_size - need_size_aligned;
+                need_size_aligned = full_size;
+            }
+            mem_brk = old_brk;
+            mem_max_addr = old_brk + need_size_aligned;
+            bp = (char*)ALIGN((size_t)mem_brk + HDR_SIZE);
+        } else {
+            mem_max_addr = mem_max_addr + need_size_aligned;
+        }
     }
 
-    // TODO: 修改下面的代码，分配 size 字节的内存空间，并更新 mem_brk，然后返回分配的内存空间的起始地址
-    char *bp = NULL;
-    // ...
-    bp = mem_brk;
-    mem_brk += size;
+#if SIZE_HDR
+    *HDRP(bp) = size;
+    user_malloc_size += size;
+#endif
+    mem_brk = bp + size;
     return (void*)bp;
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - Freeing a block does nothing. With SIZE_HDR=1 its size is
+ *     subtracted from user_malloc_size.
  */
 void mm_free(void *bp)
 {
-    // 不做任何事。
+    // 不回收内存。
+#if SIZE_HDR
+    if (bp != NULL)
+        user_malloc_size -= *HDRP(bp);
+#endif
     return;
 }
 
 double get_utilization() {
+#if SIZE_HDR
+    return (double)user_malloc_size / heap_size;
+#else
     // 在这个简单的方案中，free时没法得知释放的内存块大小，因此无法计算使用率，我们返回 NaN。
+    // SIZE_HDR=1 时才统计。
     return (double) (0.0/0.0);
-}
\ No newline at end of file
+#endif
+}
@@ -56,9 +56,9 @@
 #define ALIGNMENT 8
 
 /* 
- * Maximum heap size in bytes 
+ * Address space reserved per memlib arena; the heap grows by whole arenas
  */
-#define MAX_HEAP (5* (1 << 20)) /* 5 MB */
+#define ARENA_SIZE (64 * (1 << 20)) /* 64 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -9,32 +9,94 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 #include "memlib.h"
+#include "pagemap.h"
 #include "config.h"
 
+/*
+ * The heap is a list of arenas. Each one is mmap()ed with ARENA_SIZE bytes
+ * of address space (more if a single request needs it); pages are only
+ * backed once touched, so reserving is cheap. mem_sbrk grows the current,
+ * newest arena. When it is full the caller starts another one with
+ * mem_new_arena, so the heap as a whole is not contiguous.
+ *
+ * There are MEM_CHAINS such lists (chains), one per independent heap of
+ * the caller; mem_select picks the one this thread works on, chain 0 by
+ * default. Arena pages are tagged with PAGEMAP_ARENA(chain) in the pagemap,
+ * so mem_chain_of finds the chain, and the heap, of any address.
+ */
+struct mem_arena {
+    struct mem_arena *next;     /* the next older arena */
+    char *start;                /* first usable byte */
+    char *brk;                  /* first byte past the used part */
+    char *max_addr;             /* first byte past the arena */
+    size_t len;                 /* bytes mapped, header included */
+};
+#define ARENA_HDR ((sizeof(struct mem_arena) + 15) & ~(size_t)15)
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static struct mem_arena *mem_chain[MEM_CHAINS];    /* newest arena of each chain */
+static __thread int mem_id __attribute__((tls_model("initial-exec")));
+#define mem_cur (mem_chain[mem_id])     /* the arena mem_sbrk grows */
+
+/*
+ * arena_map - map an arena with room for at least size bytes and make it
+ *    the current one
+ */
+static struct mem_arena *arena_map(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len;
+    struct mem_arena *a;
+
+    if (size > SIZE_MAX - ARENA_HDR - page)
+        return NULL;
+    len = (size + ARENA_HDR + page - 1) & ~(page - 1);
+    if (len < ARENA_SIZE)
+        len = ARENA_SIZE;
+    a = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (a == MAP_FAILED)
+        return NULL;
+    if (pagemap_set(a, len, PAGEMAP_ARENA(mem_id)) < 0) {
+        munmap(a, len);
+        return NULL;
+    }
+    a->start = a->brk = (char *)a + ARENA_HDR;
+    a->max_addr = (char *)a + len;
+    a->len = len;
+    a->next = mem_cur;
+    mem_cur = a;
+    return a;
+}
+
+/*
+ * arena_unmap - untag and unmap the newest arena of the current chain
+ */
+static void arena_unmap(void)
+{
+    struct mem_arena *a = mem_cur;
+
+    mem_cur = a->next;
+    pagemap_set(a, a->len, PAGEMAP_NONE);
+    munmap(a, a->len);
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model: drop any old arenas and
+ *    map the first one of chain 0
  */
 void mem_init(void)
 {
-    /*
-        TODO: 
-        调用 sbrk, 初始化 mem_start_brk、mem_brk、以及 mem_max_addr
-        此处增长堆空间大小为 MAX_HEAP
-    */
-    mem_start_brk = (char*)sbrk(MAX_HEAP);
-    if (mem_start_brk == NULL) {
-        fprintf(stderr, "mem_init: sbrk failed\n");
+    mem_deinit();
+    mem_id = 0;
+    if (arena_map(0) == NULL) {
+        fprintf(stderr, "mem_init: mmap failed\n");
         exit(1);
     }
-    mem_brk = mem_start_brk;
-    mem_max_addr = mem_start_brk + MAX_HEAP;
 }
 
 /* 
@@ -42,74 +104,171 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    int id = mem_id;
+
+    for (mem_id = 0; mem_id < MEM_CHAINS; mem_id++)
+        while (mem_cur != NULL)
+            arena_unmap();
+    mem_id = id;
+}
+
+/*
+ * mem_select - make chain the one this thread's memlib calls work on. A
+ *    chain starts out empty: mem_sbrk fails until mem_new_arena.
+ */
+void mem_select(int chain)
+{
+    mem_id = chain;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_chain_of - the chain whose arena holds addr, -1 if none does
+ */
+int mem_chain_of(const void *addr)
+{
+    int val = pagemap_get(addr);
+
+    return val >= PAGEMAP_ARENA(0) ? val - PAGEMAP_ARENA(0) : -1;
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    keeping only the oldest arena. Goes through mem_trim so that the
+ *    arena reads as zeros again (mm_calloc relies on it).
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    while (mem_cur->next != NULL)
+        arena_unmap();
+    mem_trim(mem_cur->brk - mem_cur->start);
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ * mem_sbrk - simple model of the sbrk function. Extends the current arena
+ *    by incr bytes and returns the start address of the new area, or
+ *    (void *)-1 with errno ENOMEM once the arena is full. The new area
+ *    always reads as zeros, see mem_trim.
  */
 void *mem_sbrk(int incr) 
 {
-    char *old_brk = mem_brk;
-    
-    /*
-        TODO:
-            模拟堆增长
-            incr: 申请 mem_brk 的增长量
-            返回值: 旧 mem_brk 值
-        HINTS:
-        1. 若 mem_brk + incr 没有超过实际的 mem_max_addr 值，直接推进 mem_brk 值即可
-        2. 若 mem_brk + incr 超过实际的 mem_max_addr 值，需要调用 sbrk 为内存分配器掌管的内存扩容
-        3. 每次调用 sbrk 时， mem_max_addr 增量以 MAXHEAP对齐
-    */
-    long rest_size = mem_max_addr - mem_brk;
-
-    if (rest_size < incr) {
-        // 如果剩余空间不够，需要使用 sbrk 拓展
-        long need_size = incr - rest_size;  // 缺少的空间
-        long need_size_aligned = (need_size + MAX_HEAP - 1) / MAX_HEAP * MAX_HEAP;  // 上取整到 MAX_HEAP 的倍数
-
-        sbrk(need_size_aligned);
-        mem_max_addr = mem_max_addr + need_size_aligned;
+    char *old_brk;
+
+    if (mem_cur == NULL || incr < 0 || incr > mem_cur->max_addr - mem_cur->brk) {
+        errno = ENOMEM;
+        return (void *)-1;
     }
+    old_brk = mem_cur->brk;
+    mem_cur->brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_new_arena - start a new arena with room for at least size bytes.
+ *    It becomes the one mem_sbrk grows; returns its start (its brk), or
+ *    (void *)-1 if it cannot be mapped.
+ */
+void *mem_new_arena(size_t size)
+{
+    struct mem_arena *a = arena_map(size);
+
+    if (a == NULL) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    return (void *)a->start;
+}
 
-    mem_brk += incr;    // 更新mem_brk
-    
+/*
+ * mem_trim - the opposite of mem_sbrk: lowers the brk of the current arena
+ *    by decr bytes and gives the whole pages above it back to the kernel.
+ *    The reserved range stays ours, so a later mem_sbrk reuses it. The
+ *    partial pages at either end are cleared instead, so that everything
+ *    above the brk still reads as zeros.
+ */
+void *mem_trim(int decr)
+{
+    uintptr_t page = mem_pagesize();
+    char *old_brk = mem_cur->brk;
+    char *lo, *hi;
+
+    if (decr < 0 || decr > mem_cur->brk - mem_cur->start) {
+        errno = EINVAL;
+        fprintf(stderr, "mem_trim: cannot shrink below the arena start\n");
+        return (void *)-1;
+    }
+    mem_cur->brk -= decr;
+    lo = (char *)(((uintptr_t)mem_cur->brk + page - 1) & ~(page - 1));
+    hi = (char *)((uintptr_t)old_brk & ~(page - 1));
+    if (lo >= hi) {
+        memset(mem_cur->brk, 0, decr);
+    } else {
+        memset(mem_cur->brk, 0, lo - mem_cur->brk);
+        memset(hi, 0, old_brk - hi);
+        mem_release(lo, hi - lo);
+    }
     return (void *)old_brk;
 }
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_release - madvise(MADV_DONTNEED) the whole pages inside
+ *    [start, start + len). They stay mapped and read back as zeros.
+ *    Returns the number of bytes released.
+ */
+size_t mem_release(void *start, size_t len)
+{
+    uintptr_t page = mem_pagesize();
+    uintptr_t lo = ((uintptr_t)start + page - 1) & ~(page - 1);
+    uintptr_t hi = ((uintptr_t)start + len) & ~(page - 1);
+
+    if (hi <= lo || madvise((void *)lo, hi - lo, MADV_DONTNEED) < 0)
+        return 0;
+    return hi - lo;
+}
+
+/*
+ * mem_heap_lo - return address of the first byte of the current arena
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return (void *)mem_cur->start;
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last byte of the current arena
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(mem_cur->brk - 1);
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, over all arenas
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    struct mem_arena *a;
+    size_t size = 0;
+
+    for (a = mem_cur; a != NULL; a = a->next)
+        size += (size_t)(a->brk - a->start);
+    return size;
+}
+
+/*
+ * mem_arena_range - the used part [*lo, *hi) of the i-th newest arena of
+ *    the current chain. Returns 0, or -1 if the chain has no such arena.
+ */
+int mem_arena_range(int i, char **lo, char **hi)
+{
+    struct mem_arena *a = mem_cur;
+
+    while (a != NULL && i-- > 0)
+        a = a->next;
+    if (a == NULL)
+        return -1;
+    *lo = a->start;
+    *hi = a->brk;
+    return 0;
 }
 
 /*
@@ -4,13 +4,21 @@
 extern "C" {
 #endif
 
+#define MEM_CHAINS 64   /* independent arena chains, see mem_select */
+
 void mem_init(void);               
+void mem_select(int chain);
+int mem_chain_of(const void *addr);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+void *mem_new_arena(size_t size);
+void *mem_trim(int decr);
+size_t mem_release(void *start, size_t len);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+int mem_arena_range(int i, char **lo, char **hi);
 size_t mem_pagesize(void);
 
 #ifdef __cplusplus
@@ -5,84 +5,500 @@
  * and get a clear view about the memory structure of free and allocated
  * block before you start coding.
  */
+#define _GNU_SOURCE     /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#if THREAD_SAFE
+#include <pthread.h>
+#endif
+#if HEAPS && !THREAD_SAFE
+#error "HEAPS needs THREAD_SAFE=1"
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#if SLAB
+#include "slab.h"
+#endif
+#if PROFILE
+#include "profile.h"
+#endif
 
 
-/* Word takes 8 bytes and double word takes 16 bytes */
+/* Word takes 8 bytes and double word takes 16 bytes, a head or foot (tag) takes 4 bytes */
 #define WSIZE 8
 #define DSIZE 16
+#define TSIZE 4
 #define CHUNKSIZE (1 << 12)
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /*
-    Each head or foot is WSIZE-sized and organized as below:
-    |---------size (62bits)----------|--prev_alloc (1 bit)--|---alloc (1 bit)---|
+    Each head or foot is TSIZE-sized and organized as below:
+    |---------size (29bits)----------|--unused (1 bit)--|--prev_alloc (1 bit)--|---alloc (1 bit)---|
 
-    Value of size is a multiple of 8, so the 2 lowest bits can be used by prev_alloc and alloc.
+    Value of size is a multiple of 8, so the 3 lowest bits can be used as flags.
+    Blocks look like this (payloads are ALIGNMENT-aligned, so heads sit 4 bytes before):
+
+        allocated:  | head | payload ...................... |
+        free:       | head | pred (8) | succ (8) | ... | foot |
+
+    Only free blocks have a foot; the prev_alloc bit of the next block says whether
+    the foot is there. A block is therefore at least 4 + 8 + 8 + 4 = 24 bytes.
 */
 /* Pack each argument in the order in brackets */
 #define PACK(size, prev_alloc, alloc) (((size) & ~0x7) | ((prev_alloc << 1) & ~0x1) | (alloc)) // In fact, we enforce SIZE to be multiple of 8 :)
 #define PACK_PREV_ALLOC(val, prev_alloc) ((val & ~(1<<1)) | (prev_alloc << 1))
 #define PACK_ALLOC(val, alloc) ((val) | (alloc))
 
+/* Read and write a head or foot at address p */
+#define GET(p) (*(unsigned int *)(p))
+#define PUT(p, val) (*(unsigned int *)(p) = (val))
+
 /* Read and write a word at address p */
-#define GET(p) (*(unsigned long *)(p))
-#define PUT(p, val) (*(unsigned long *)(p) = (val))
+#define GET_WORD(p) (*(unsigned long *)(p))
+#define PUT_WORD(p, val) (*(unsigned long *)(p) = (val))
 
 /* Use mask to get different fields at address p */
-#define GET_SIZE(p) (GET(p) & ~0x7)
+#define GET_SIZE(p) ((size_t)(GET(p) & ~0x7))
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define GET_PREV_ALLOC(p) ((GET(p) & 0x2) >> 1)
 
 /* Get head, foot, previous and next block of block bp.
    NOTE: bp is the beginning address of the block, not the addressof head */
-#define HDRP(bp) ((char *)(bp)-WSIZE)
-#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) /*only for free blk*/
-#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
-#define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE))) /*only when prev_block is free, which can usd*/
-
-#define GET_PRED(bp) (GET(bp))
-#define SET_PRED(bp, val) (PUT(bp, val))
+#define HDRP(bp) ((char *)(bp)-TSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - 2 * TSIZE) /*only for free blk*/
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+#define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp) - 2 * TSIZE))) /*only when prev_block is free, which can usd*/
 
-#define GET_SUCC(bp) (GET(bp + WSIZE))
-#define SET_SUCC(bp, val) (PUT(bp + WSIZE, val))
+#define GET_PRED(bp) (GET_WORD(bp))
+#define SET_PRED(bp, val) (PUT_WORD(bp, val))
 
-#define MIN_BLK_SIZE (2 * DSIZE)
-/*explicit free list end*/
+#define GET_SUCC(bp) (GET_WORD((char *)(bp) + WSIZE))
+#define SET_SUCC(bp, val) (PUT_WORD((char *)(bp) + WSIZE, val))
 
-/* single word (8) or double word (16) alignment */
+/* single word (8) or double word (16) alignment, make ALIGN16=1 picks the latter */
+#if ALIGN16
+#define ALIGNMENT DSIZE
+#else
 #define ALIGNMENT WSIZE
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+#define MIN_BLK_SIZE ALIGN(TSIZE + 2 * WSIZE + TSIZE)
+#define MAX_BLK_SIZE (1UL << 30) /* sizes must fit in a tag and in mem_sbrk's int */
+/*explicit free list end*/
+
+/*
+    Segregated free lists (SEG_LIST=1): free blocks are kept in SEG_NUM lists
+    by size class, and the list heads live in front of the prologue block.
+    Class 0 holds blocks up to 32 bytes, then every power of two is split
+    into two halves:
+        (32, 48], (48, 64], (64, 96], (96, 128], (128, 192], ...
+    and the last class takes everything bigger.
+*/
+#define SEG_NUM 32
+#define SEG_MIN_SHIFT 5 /* log2(32), the upper bound of class 0 */
+
+/*
+    Fit policies (mm_set_policy): how find_fit picks a block among those in
+    a free list, see MM_FIT_* in mm.h. With SEG_LIST=1 the search still
+    stops at the lowest class that has a fitting block. Next fit keeps a
+    roving pointer to where the last search stopped; it moves on to the
+    successor when that block leaves its list. Good fit takes the best of
+    the first good_fit_depth fitting blocks, or the first one at most
+    good_fit_slack bytes too big (mm_set_good_fit). Best fit stops at an
+    exact fit. The treap below is always searched best fit. FIRST_FIT=1
+    only picks the default policy.
+*/
+#define GOOD_FIT_DEPTH 8
+
+/*
+    Tree fit (TREE_FIT=1): free blocks of at least TREE_MIN_SIZE bytes are kept
+    in a treap ordered by (size, address) instead of a list. The two link words
+    of the free block become the left and right child, and the heap priority is
+    a hash of the block address, so nothing else has to be stored. Smaller
+    blocks stay in the free list(s) above.
+*/
+#define TREE_MIN_SIZE 512
+#define LEFT(bp) (*(char **)(bp))
+#define RIGHT(bp) (*(char **)((char *)(bp) + WSIZE))
+#define TREE_PRIO(bp) ((unsigned int)(((size_t)(bp) * 0x9E3779B97F4A7C15UL) >> 32))
+#define TREE_LESS(a, b) (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+                         (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+
+/*
+    The heap is made of memlib arenas that are not adjacent to each other.
+    Every arena starts with its own padding + prologue and ends with its
+    own epilogue, so coalescing never crosses an arena. Only the newest
+    arena can grow (mem_sbrk); IS_LAST_BLK tells whether bp ends it.
+*/
+#define IS_LAST_BLK(bp) ((char *)NEXT_BLKP(bp) == (char *)mem_heap_hi() + 1)
+
+/*
+    Slab (SLAB=1): requests of at most SLAB_MAX_SIZE bytes are served from
+    slab.c, which packs header-less slots of one size into 4 KB pages. The
+    pages come from this heap in spans (slab_span_alloc), so the boundary-tag
+    heap stays one contiguous piece. Slab objects are told apart from heap
+    blocks with slab_owns(), not by a header.
+*/
+
+/*
+    Trimming (TRIM=1): when a free block at the end of the newest arena
+    reaches TRIM_THRESHOLD, all but TRIM_KEEP bytes of it go back to the
+    kernel via mem_trim(). Any other free block of at least RELEASE_THRESHOLD
+    keeps its address range, but its whole pages are dropped with
+    mem_release() and fault back in as zeros when reused.
+*/
+#define TRIM_THRESHOLD (128 * 1024)
+#define TRIM_KEEP CHUNKSIZE
+#define RELEASE_THRESHOLD (16 * 1024)
+
+/*
+    Direct mmap (MMAP=1): requests of at least mmap_threshold bytes get a
+    mapping of their own and never enter the heap, so ARENA_SIZE and
+    MAX_BLK_SIZE do not limit them. The mapping length (a size_t) sits in
+    the first DSIZE bytes, then the usual head with size 0 and MMAP_BIT set:
+
+        | len (8) | unused (4) | head | payload ...           |
+        ^ page aligned                ^ bp, DSIZE aligned
+
+    A block from mm_memalign may start further in: the mapping then begins
+    at the page holding bp - DSIZE (MMAP_BASE), and len counts from there.
+    MMAP_BIT is never set in the head of an allocated heap block, and slab objects
+    are checked for before any head is read.
+*/
+#define MMAP_THRESHOLD (128 * 1024)
+#define MMAP_BIT 0x4
+#define IS_MMAPPED(bp) (GET(HDRP(bp)) & MMAP_BIT)
+#define MMAP_LEN(bp) (*(size_t *)((char *)(bp) - DSIZE))
+#define MMAP_BASE(bp) ((char *)(((uintptr_t)(bp) - DSIZE) & ~(uintptr_t)(mem_pagesize() - 1)))
+#define MMAP_PAYLOAD(bp) (MMAP_LEN(bp) - (size_t)((char *)(bp) - MMAP_BASE(bp)))
+
+/*
+    Zeroed free blocks (for mm_calloc): ZERO_BIT, the bit of MMAP_BIT, marks
+    a free heap block whose payload is known to read as zeros apart from its
+    list links and foot: fresh from mem_sbrk (extend_heap) or, with TRIM=1,
+    released to the kernel as a whole. Coalescing keeps the bit when every
+    part has it, a split passes it on to the rest, and allocating a block
+    always writes a new head without it, so it never shows in a head that
+    IS_MMAPPED looks at.
+*/
+#define ZERO_BIT 0x4
+#define IS_ZERO(bp) (GET(HDRP(bp)) & ZERO_BIT)
+
+/*
+    Batches (mm_malloc_batch, mm_free_batch): the requests the heap itself
+    serves are handled under one lock and counted in one go. mm_malloc_batch
+    looks for a free block for a run of up to BATCH_RUN_MAX bytes of blocks
+    (else for the first of them) and lays out in it as many as fit, side by
+    side, so it pays a fit search and a split per free block, not per
+    block; mm_free_batch frees up to BATCH_FREE_MAX blocks per lock. Slab,
+    tcache and mmap requests take their usual path one by one.
+*/
+#define BATCH_RUN_MAX (16 * CHUNKSIZE)
+#define BATCH_FREE_MAX 256
+#define BATCH_SIZE(sizes, size, i) ((sizes) != NULL ? (sizes)[i] : (size))
+
+/*
+    Deferred coalescing (DEFER=1): free_block does not coalesce a block of
+    at most QUICK_MAX_SIZE bytes but pushes it, still marked as allocated,
+    on the quick list for its exact size, and malloc_block takes an exact
+    fit from there before searching the free lists. The quick lists are
+    consolidated, i.e. all their blocks freed and coalesced for real
+    (merge_block), when a fit search fails or when they hold more than
+    QUICK_MAX_BYTES. Like tcache blocks, quick blocks count as used in
+    get_utilization().
+*/
+#define QUICK_MAX_SIZE 1024
+#define QUICK_BINS ((QUICK_MAX_SIZE - MIN_BLK_SIZE) / ALIGNMENT + 1)
+#define QUICK_IDX(size) (((size) - MIN_BLK_SIZE) / ALIGNMENT)
+#define QUICK_MAX_BYTES (1024 * 1024)
+#define QUICK_NEXT(bp) (*(void **)(bp))
+
+/*
+    Statistics (MM_STATS=1): event counters for mm_stats(). Without the flag
+    STAT_ADD compiles to ((void)0); in thread-safe builds it is a relaxed
+    atomic add, as the counters are shared by all threads and heaps.
+*/
+#if MM_STATS
+static struct mm_stats stats;   /* only the event counters are used */
+#if THREAD_SAFE
+#define STAT_ADD(field, n) __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(field, n) (stats.field += (n))
+#endif
+#else
+#define STAT_ADD(field, n) ((void)0)
+#endif
+#define STAT_INC(field) STAT_ADD(field, 1)
+
+/*
+    Heap checking: mm_checkheap(level) verifies the heap and reports the
+    first problem on stderr. With HEAP_CHECK=1, mm_malloc/mm_free/mm_realloc
+    also run it on every check_every-th call (mm_set_check, or the
+    MM_CHECK_EVERY environment variable at mm_init) and abort() on failure,
+    so a long-running program catches corruption close to where it happens.
+    Without the flag CHECK_SAMPLE compiles to ((void)0).
+*/
+#define CHECK_LEVEL 2
+#if HEAP_CHECK
+static int check_level = CHECK_LEVEL;
+static unsigned long check_every;   /* 0: no sampling */
+static unsigned long check_ops;
+static void check_sample(void);
+#define CHECK_SAMPLE() check_sample()
+#else
+#define CHECK_SAMPLE() ((void)0)
+#endif
 
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+/*
+    Heap profiling (PROFILE=1): every block mm_malloc hands out goes through
+    PROF_MALLOC, which samples about one per prof_rate bytes (see profile.c);
+    mm_free and the in-place paths of mm_realloc tell the profiler about
+    sampled blocks that die or move. Without the flag these compile away.
+*/
+#if PROFILE
+_Static_assert(MM_PROFILE_FOLDED == PROF_FOLDED && MM_PROFILE_PPROF == PROF_PPROF, "profile formats");
+#define PROF_MALLOC(bp, size) prof_malloc((bp), (size))
+#define PROF_FREE(bp) prof_free(bp)
+#define PROF_REALLOC(oldp, newp, size) prof_realloc((oldp), (newp), (size))
+#else
+#define PROF_MALLOC(bp, size) (bp)
+#define PROF_FREE(bp) ((void)0)
+#define PROF_REALLOC(oldp, newp, size) ((void)0)
+#endif
 
 static char *heap_listp;
+#if HEAPS
+/*
+    Heaps (HEAPS=N): N independent heaps, each with its own lock, free
+    lists, counters and chain of memlib arenas (mem_select). A thread is
+    handed a heap round-robin on its first call. The internal functions
+    work on cur_heap, set by heap_enter(); the free list roots here and the
+    counters further down are macros for its fields.
+    A block always goes back to the heap whose arena holds it (heap_of).
+    A thread freeing a block of another heap pushes it on that heap's
+    remote stack without locking, and the owner frees the whole stack the
+    next time it enters the heap. Once the last thread of a heap has
+    exited nobody enters it again, so remote_free frees into such a heap
+    itself.
+*/
+struct mm_heap {
+    pthread_mutex_t lock;
+    int id;                     /* memlib chain */
+#if SEG_LIST
+    char *seg_heads[SEG_NUM];
+#else
+    char *free_listp;
+#endif
+#if TREE_FIT
+    char *tree_root;
+#endif
+#if DEFER
+    void *quick_heads[QUICK_BINS];
+    size_t quick_bytes;
+#endif
+    char *rover;                /* next fit */
+    void *remote;               /* blocks freed by other threads */
+    int threads;                /* live threads using this heap */
+    size_t user_malloc_size;
+    size_t heap_size;
+    size_t trimmed_size;
+    size_t released_size;
+} __attribute__((aligned(64)));
+
+static struct mm_heap heaps[HEAPS];
+static __thread struct mm_heap *cur_heap __attribute__((tls_model("initial-exec")));
+#if SEG_LIST
+#define seg_listp (cur_heap->seg_heads)
+#define LIST_HEAD(size) (seg_listp[seg_index(size)])
+#else
+#define free_listp (cur_heap->free_listp)
+#define LIST_HEAD(size) (free_listp)
+#endif
+#if TREE_FIT
+#define tree_root (cur_heap->tree_root)
+#endif
+#if DEFER
+#define quick_heads (cur_heap->quick_heads)
+#define quick_bytes (cur_heap->quick_bytes)
+#endif
+#define rover (cur_heap->rover)
+#else
+#if SEG_LIST
+static char **seg_listp; /* SEG_NUM list heads, stored before the prologue */
+#define LIST_HEAD(size) (seg_listp[seg_index(size)])
+#else
 static char *free_listp;
-
+#define LIST_HEAD(size) (free_listp)
+#endif
+#if TREE_FIT
+static char *tree_root;
+#endif
+#if DEFER
+static void *quick_heads[QUICK_BINS];   /* quick lists by exact block size */
+static size_t quick_bytes;              /* bytes on all quick lists */
+#endif
+static char *rover;     /* next fit: where the last search stopped */
+#endif
 #if FIRST_FIT
-static void *find_fit_first(size_t asize);
+static int fit_policy = MM_FIT_FIRST;
 #else
-static void *find_fit_best(size_t asize);
+static int fit_policy = MM_FIT_BEST;
 #endif
+static int good_fit_depth = GOOD_FIT_DEPTH;
+static size_t good_fit_slack = 0;
+
+static void *find_fit(size_t asize);
 
 static void *extend_heap(size_t words);
+static char *put_sentinels(char *p);
+static char *arena_first_block(char *lo, char *hi);
+static void stats_walk(struct mm_stats *st);
+static int check_heap(int level);
 static void *coalesce(void *bp);
+static void *malloc_block(size_t asize, int *zero);
+static size_t heap_asize(size_t size);
+static size_t malloc_run(const size_t *sizes, size_t size, size_t i, size_t j, size_t total,
+                         size_t *nofit, void **ptrs);
+static int free_unlocked(void *bp);
+#if THREAD_SAFE
+static int sized_bin(void *bp, size_t size);
+#endif
+#if HEAP_CHECK
+static int check_size(void *bp, size_t size);
+#endif
+static void free_blocks(void **bps, size_t n);
+static void *memalign_block(size_t align, size_t asize);
+static void free_block(void *bp);
+static void merge_block(void *bp);
+static int realloc_in_place(void *bp, size_t asize);
+#if TRIM
+static void trim_block(void *bp, char *lo, char *hi);
+#endif
+#if MMAP
+static void *mmap_block(size_t size, size_t align);
+static void munmap_block(void *bp);
+static void *mremap_block(void *bp, size_t size);
+#endif
+#if SLAB
+static void *slab_malloc_block(size_t size);
+static void slab_free_block(void *bp);
+static void *slab_span_alloc(size_t size);
+static void slab_span_free(void *bp);
+#endif
 // static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
 static void add_to_free_list(void *bp);
 static void delete_from_free_list(void *bp);
+#if SEG_LIST
+static int seg_index(size_t size);
+#endif
+#if DEFER
+static void quick_put(void *bp, size_t size);
+static void *quick_get(size_t size);
+static void consolidate(void);
+#endif
+#if TREE_FIT
+static void tree_insert(void *bp);
+static void tree_delete(void *bp);
+static void *tree_find(size_t asize);
+#endif
 double get_utilization();
 void mm_check(const char * function, char* bp);
 
+#if THREAD_SAFE
+/*
+    Thread-safe mode (THREAD_SAFE=1).
+
+    The heap itself stays a single explicit/segregated free list heap and is
+    guarded by heap_lock. In front of it every thread keeps a cache (tcache)
+    of blocks for each exact block size up to TCACHE_MAX_SIZE:
+      - mm_malloc pops from the thread's own bin without any locking; on a
+        miss it takes the lock once and carves a batch of blocks;
+      - mm_free pushes onto the bin; when a bin grows past TCACHE_MAX_COUNT
+        half of it is flushed back to the heap under one lock.
+    Cached blocks stay marked as allocated in the heap, so they are not
+    coalesced and still count as used in get_utilization().
+    With SLAB=1 there is one more bin per slab slot size after the heap bins.
+*/
+#define TCACHE_MAX_SIZE 1040                                    /* largest cached block */
+#define TCACHE_HEAP_BINS ((TCACHE_MAX_SIZE - MIN_BLK_SIZE) / ALIGNMENT + 1)
+#define TCACHE_IDX(size) (((size) - MIN_BLK_SIZE) / ALIGNMENT)
+#if SLAB
+#define TCACHE_SLAB_BINS (SLAB_MAX_SIZE / ALIGNMENT)
+#define TCACHE_SLAB_IDX(size) (TCACHE_HEAP_BINS + (size) / ALIGNMENT - 1)
+#else
+#define TCACHE_SLAB_BINS 0
+#endif
+#define TCACHE_BINS (TCACHE_HEAP_BINS + TCACHE_SLAB_BINS)
+#define TCACHE_MAX_COUNT 64                                     /* blocks per bin before flushing */
+#define TCACHE_FILL_BYTES 4096                                  /* bytes carved per refill */
+#define TCACHE_FILL_MAX 16                                      /* blocks carved per refill */
+
+#define TCACHE_NEXT(bp) (*(void **)(bp))
+
+struct tcache {
+    void *head[TCACHE_BINS];
+    unsigned short count[TCACHE_BINS];
+    int registered;     /* thread exit destructor installed */
+};
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static __thread struct tcache tcache __attribute__((tls_model("initial-exec")));
+
+#if HEAPS
+#define REMOTE_NEXT(bp) (*(void **)(bp))
+
+static unsigned int next_heap;  /* round-robin counter for thread_heap */
+static __thread struct mm_heap *my_heap __attribute__((tls_model("initial-exec")));
+
+static void heap_enter(struct mm_heap *h);
+static void heap_leave(void);
+static struct mm_heap *thread_heap(void);
+static struct mm_heap *heap_of(void *bp);
+static void remote_free(struct mm_heap *h, void *bp);
+
+#define LOCK() heap_enter(thread_heap())
+#define UNLOCK() heap_leave()
+#define LOCK_OWNER(bp) heap_enter(heap_of(bp))
+#if SLAB
+/* the slab is shared by all threads and lives in heap 0 */
+#define TCACHE_LOCK(idx) ((idx) >= TCACHE_HEAP_BINS ? heap_enter(&heaps[0]) : LOCK())
+#endif
+#else
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define LOCK() pthread_mutex_lock(&heap_lock)
+#define UNLOCK() pthread_mutex_unlock(&heap_lock)
+#define LOCK_OWNER(bp) LOCK()
+#endif
+#ifndef TCACHE_LOCK
+#define TCACHE_LOCK(idx) LOCK()
+#endif
+
+static void *tcache_get(int idx, size_t size);
+static void tcache_put(int idx, void *bp);
+static void tcache_flush(int idx, int keep);
+static void tcache_destroy(void *arg);
+static void tcache_key_create(void);
+#else
+#define LOCK()
+#define UNLOCK()
+#define LOCK_OWNER(bp)
+#endif
+
 /*
     TODO:
         完成一个简单的分配器内存使用率统计
@@ -94,31 +510,194 @@ void mm_check(const char * function, char* bp);
 */
 size_t user_malloc_size = 0;
 size_t heap_size = 0;
+size_t trimmed_size = 0;    /* bytes given back by lowering the brk */
+size_t released_size = 0;   /* bytes madvise()d away inside the heap */
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static size_t mmap_min_threshold = MMAP_THRESHOLD; /* the lowest ever set: smaller requests are never mapped */
+
+/*
+ * mm_set_policy - pick the fit policy (MM_FIT_*). Returns the previous one,
+ *     or -1 if policy is unknown.
+ */
+int mm_set_policy(int policy)
+{
+    if (policy < 0 || policy >= MM_FIT_POLICIES)
+        return -1;
+    return __atomic_exchange_n(&fit_policy, policy, __ATOMIC_RELAXED);
+}
+
+/*
+ * mm_set_good_fit - make good fit take the best of the first depth fitting
+ *     blocks (depth <= 0: no limit), ending early on a block at most slack
+ *     bytes bigger than needed
+ */
+void mm_set_good_fit(int depth, size_t slack)
+{
+    good_fit_depth = depth > 0 ? depth : INT_MAX;
+    good_fit_slack = slack;
+}
+
+/*
+ * mm_set_mmap_threshold - requests of at least threshold bytes are mmap()ed
+ *     directly (MMAP=1 only). Thresholds above MAX_BLK_SIZE are clamped, so
+ *     anything the heap cannot hold is always mapped.
+ */
+void mm_set_mmap_threshold(size_t threshold)
+{
+    mmap_threshold = MIN(MAX(threshold, 1), MAX_BLK_SIZE);
+    if (mmap_threshold < mmap_min_threshold)
+        mmap_min_threshold = mmap_threshold;
+}
+
+/*
+ * mm_set_check - run mm_checkheap(level) on every every-th call of
+ *     mm_malloc/mm_free/mm_realloc, 0 to stop (HEAP_CHECK=1 only).
+ */
+void mm_set_check(int level, unsigned long every)
+{
+#if HEAP_CHECK
+    check_level = level;
+    check_every = every;
+#endif
+}
+
+/*
+ * mm_set_profile_rate - sample one allocation per rate bytes on average,
+ *     0 to stop (PROFILE=1 only)
+ */
+void mm_set_profile_rate(size_t rate)
+{
+#if PROFILE
+    prof_set_rate(rate);
+#endif
+}
+
+/*
+ * mm_profile_dump - write the heap profile to path, see mm.h. Returns 0,
+ *     or -1 if it cannot be written or profiling is not built in.
+ */
+int mm_profile_dump(const char *path, int format)
+{
+#if PROFILE
+    int fd, ret;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+    ret = prof_dump(fd, format);
+    close(fd);
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+#if PROFILE
+/*
+ * profile_at_exit - dump the profile to $MM_PROFILE, in the format named
+ *     by $MM_PROFILE_FORMAT (folded unless "pprof")
+ */
+static void profile_at_exit(void)
+{
+    const char *fmt = getenv("MM_PROFILE_FORMAT");
+    const char *path = getenv("MM_PROFILE");
+
+    if (path != NULL && mm_profile_dump(path, fmt != NULL && !strcmp(fmt, "pprof") ?
+                                        MM_PROFILE_PPROF : MM_PROFILE_FOLDED) < 0)
+        fprintf(stderr, "mm: cannot write heap profile to %s\n", path);
+}
+#endif
 double get_utilization() {
+#if HEAPS
+    /* sum up the heaps, which also refreshes the exported counters */
+    int i;
+
+    user_malloc_size = heap_size = trimmed_size = released_size = 0;
+    for (i = 0; i < HEAPS; i++) {
+        user_malloc_size += heaps[i].user_malloc_size;
+        heap_size += heaps[i].heap_size;
+        trimmed_size += heaps[i].trimmed_size;
+        released_size += heaps[i].released_size;
+    }
+#endif
     if (heap_size == 0) {
         return 0.0;
     }
     return (double)user_malloc_size / heap_size;
     // return 0;
 }
+#if HEAPS
+#define user_malloc_size (cur_heap->user_malloc_size)
+#define heap_size (cur_heap->heap_size)
+#define trimmed_size (cur_heap->trimmed_size)
+#define released_size (cur_heap->released_size)
+#endif
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
+#if HEAP_CHECK || PROFILE
+    char *env;
+#endif
+#if PROFILE
+    static int profile_registered;
+#endif
+#if HEAPS
+    int i;
+#endif
+
     mem_init();     // 请添加该行。
+#if THREAD_SAFE
+    pthread_once(&tcache_key_once, tcache_key_create);
+#endif
+#if HEAP_CHECK
+    if ((env = getenv("MM_CHECK_EVERY")) != NULL)
+        check_every = strtoul(env, NULL, 0);
+#endif
+#if PROFILE
+    prof_set_rate((env = getenv("MM_PROFILE_RATE")) != NULL ? strtoul(env, NULL, 0) : PROF_RATE);
+    if (getenv("MM_PROFILE") != NULL && !profile_registered) {
+        profile_registered = 1;
+        atexit(profile_at_exit);
+    }
+#endif
+#if HEAPS
+    // 其余的堆在第一次 extend_heap 时才向 memlib 要 arena
+    for (i = 0; i < HEAPS; i++) {
+        memset(&heaps[i], 0, sizeof(heaps[i]));
+        pthread_mutex_init(&heaps[i].lock, NULL);
+        heaps[i].id = i;
+    }
+    cur_heap = &heaps[0];   /* mem_init selected chain 0 */
+#endif
+#if SEG_LIST && HEAPS
+    // 表头在 struct mm_heap 里，已经清零
+#elif SEG_LIST
+    // 分离链表的表头放在序言块之前，SEG_NUM 为偶数，不影响后面的对齐
+    if ((seg_listp = mem_sbrk(SEG_NUM * WSIZE)) == (void *)-1)
+        return -1;
+    memset(seg_listp, 0, SEG_NUM * WSIZE);
+#else
     free_listp = NULL;
+#endif
+#if TREE_FIT
+    tree_root = NULL;
+#endif
+#if DEFER && !HEAPS
+    memset(quick_heads, 0, sizeof(quick_heads));
+    quick_bytes = 0;
+#endif
+#if !HEAPS
+    rover = NULL;
+#endif
+#if SLAB
+    slab_init(slab_span_alloc, slab_span_free);
+#endif
 
     // 给 heap_listp 这个地址赋值
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+    if ((heap_listp = mem_sbrk(4 * TSIZE)) == (void *)-1)
         return -1;
-
-    // 给 heap_listp 地址开头的连续四个内存空间写数据
-    PUT(heap_listp, 0);     // 0 表示空闲块，1 表示分配块
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1, 1));
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1, 1));
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1, 1));
-    heap_listp += (2 * WSIZE);
+    heap_listp = put_sentinels(heap_listp);
 
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
         return -1;
@@ -132,110 +711,1246 @@ int mm_init(void)
 void *mm_malloc(size_t size)
 {
     size_t newsize;         /* Adjusted block size */
-    size_t extend_size;     /* Amount to extend head if not fit */
     char *bp;
 
     /* Ignore spurious requesets */
+    CHECK_SAMPLE();
     if (size == 0)
         return NULL;
+    STAT_INC(mallocs);
+#if MMAP
+    if (size >= mmap_threshold)
+        return PROF_MALLOC(mmap_block(size, DSIZE), size);
+#endif
+    if (size > MAX_BLK_SIZE)
+        return NULL;
+#if SLAB
+    if (size <= SLAB_MAX_SIZE) {
+        newsize = ALIGN(size);  /* slab slots have no header */
+#if THREAD_SAFE
+        return PROF_MALLOC(tcache_get(TCACHE_SLAB_IDX(newsize), newsize), size);
+#else
+        return PROF_MALLOC(slab_malloc_block(newsize), size);
+#endif
+    }
+#endif
     /* Adjust block size to include overhead and alignment reqs. */
-    newsize = MAX(MIN_BLK_SIZE, ALIGN((size + WSIZE)));
+    newsize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
 
-    /* Search the free list for a fit */
-    #if FIRST_FIT
-    if ((bp = find_fit_first(newsize)) != NULL)
-    {
-        // mm_check(__FUNCTION__, bp);
-        place(bp, newsize);
-        // user_malloc_size += size; // Add the user-requested size
-        return bp;
+#if THREAD_SAFE
+    if (newsize <= TCACHE_MAX_SIZE)
+        return PROF_MALLOC(tcache_get(TCACHE_IDX(newsize), newsize), size);
+#endif
+    LOCK();
+    bp = malloc_block(newsize, NULL);
+    UNLOCK();
+    return PROF_MALLOC(bp, size);
+}
+
+/*
+ * mm_calloc - allocate nmemb * size bytes of zeros. A heap block known to
+ *     be zero (ZERO_BIT) only needs its list links and foot cleared, and a
+ *     new mapping (MMAP=1) nothing at all, so large zeroed buffers cost
+ *     about as much as mm_malloc.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    size_t bytes, asize;
+    int zero = 0;
+    char *bp;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes))
+        return NULL;
+#if MMAP
+    if (bytes >= mmap_threshold) {
+        STAT_INC(zero_hits);
+        return mm_malloc(bytes);
     }
-    #else
-    if ((bp = find_fit_best(newsize)) != NULL)
-    {
-        // mm_check(__FUNCTION__, bp);
-        place(bp, newsize);
-        // user_malloc_size += size; // Add the user-requested size
+#endif
+    if ((asize = heap_asize(bytes)) == 0) {
+        if ((bp = mm_malloc(bytes)) != NULL)
+            memset(bp, 0, bytes);
         return bp;
     }
-    #endif
-    /*no fit found.*/
-    extend_size = MAX(newsize, CHUNKSIZE);
-    if ((bp = extend_heap(extend_size / WSIZE)) == NULL)
-    {
+
+    CHECK_SAMPLE();
+    STAT_INC(mallocs);
+    LOCK();
+    bp = malloc_block(asize, &zero);
+    UNLOCK();
+    if (bp == NULL)
         return NULL;
+    if (zero) {
+        STAT_INC(zero_hits);
+        memset(bp, 0, 2 * WSIZE);
+        PUT(FTRP(bp), 0);
+    } else {
+        memset(bp, 0, bytes);
     }
-    place(bp, newsize);
-    // user_malloc_size += size; // Add the user-requested size
-    return bp;
+    return PROF_MALLOC(bp, bytes);
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * heap_asize - the block size mm_malloc asks malloc_block for to serve
+ *     size bytes, 0 if it serves them some other way (slab, tcache, mmap)
+ *     or not at all
  */
-void mm_free(void *bp)
+static size_t heap_asize(size_t size)
 {
-    // get utilization
-    size_t block_size = GET_SIZE(HDRP(bp));
-    user_malloc_size -= block_size - WSIZE; // Subtract user space (block size minus header)
+    size_t asize;
 
-    size_t size = GET_SIZE(HDRP(bp));
-    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
-    void *head_next_bp = NULL;
+    if (size == 0 || size > MAX_BLK_SIZE)
+        return 0;
+#if MMAP
+    if (size >= mmap_threshold)
+        return 0;
+#endif
+#if SLAB
+    if (size <= SLAB_MAX_SIZE)
+        return 0;
+#endif
+    asize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
+#if THREAD_SAFE
+    if (asize <= TCACHE_MAX_SIZE)
+        return 0;
+#endif
+    return asize;
+}
 
-    PUT(HDRP(bp), PACK(size, prev_alloc, 0));
-    PUT(FTRP(bp), PACK(size, prev_alloc, 0));
-    // mm_check(__FUNCTION__, bp);
+/*
+ * malloc_batch - see mm_malloc_batch: ptrs[i] gets sizes[i] bytes, or size
+ *     bytes if sizes is NULL. Returns how many were allocated.
+ */
+static size_t malloc_batch(const size_t *sizes, size_t size, size_t n, void **ptrs)
+{
+    size_t i, j, asize, total, nheap = 0, done = 0, nofit = SIZE_MAX;
+
+    for (i = 0; i < n; i++) {
+        if (heap_asize(BATCH_SIZE(sizes, size, i)) != 0) {
+            nheap++;
+            continue;
+        }
+        if ((ptrs[i] = mm_malloc(BATCH_SIZE(sizes, size, i))) != NULL)
+            done++;
+    }
+    if (nheap == 0)
+        return done;
+
+    CHECK_SAMPLE();
+    STAT_ADD(mallocs, nheap);
+    LOCK();
+    for (i = 0; i < n; i = j) {
+        /* the next run: heap blocks of at most BATCH_RUN_MAX bytes together */
+        for (j = i, total = 0; j < n; j++) {
+            if ((asize = heap_asize(BATCH_SIZE(sizes, size, j))) == 0)
+                continue;
+            if (total != 0 && total + asize > BATCH_RUN_MAX)
+                break;
+            total += asize;
+        }
+        if (total != 0)
+            done += malloc_run(sizes, size, i, j, total, &nofit, ptrs);
+    }
+    UNLOCK();
+#if PROFILE
+    for (i = 0; i < n; i++)
+        if (ptrs[i] != NULL && heap_asize(BATCH_SIZE(sizes, size, i)) != 0)
+            ptrs[i] = PROF_MALLOC(ptrs[i], BATCH_SIZE(sizes, size, i));
+#endif
+    return done;
+}
+
+/*
+ * batch_fit - a free block for a run of total bytes that starts with a
+ *     block of asize bytes: one for the whole run if there is one, else
+ *     one for its first block, else from extend_heap. *nofit is a size no
+ *     free block is known to have, so that a batch does not search for it
+ *     again.
+ */
+static char *batch_fit(size_t total, size_t asize, size_t *nofit)
+{
+    char *bp;
+
+    if (total < *nofit) {
+        if ((bp = find_fit(total)) != NULL)
+            return bp;
+        *nofit = total;
+    }
+    if (asize < *nofit) {
+        if ((bp = find_fit(asize)) != NULL)
+            return bp;
+        *nofit = asize;
+    }
+#if DEFER
+    if (quick_bytes != 0) {
+        consolidate();
+        *nofit = SIZE_MAX;
+        if ((bp = find_fit(asize)) != NULL)
+            return bp;
+    }
+#endif
+    *nofit = SIZE_MAX;      /* what is left of the new block may fit later */
+    return extend_heap(MAX(total, CHUNKSIZE) / WSIZE);
+}
+
+/*
+ * malloc_run - allocate the heap blocks of ptrs[i..j), total bytes in all.
+ *     Each free block found takes as many of them as fit, side by side, so
+ *     the run costs a fit search and a split per free block used rather
+ *     than per block. Returns how many were allocated. The caller holds
+ *     heap_lock in thread-safe mode.
+ */
+static size_t malloc_run(const size_t *sizes, size_t size, size_t i, size_t j, size_t total,
+                         size_t *nofit, void **ptrs)
+{
+    size_t asize, fill, prev_alloc, k, done = 0;
+    char *bp;
+
+    for (; i < j; i = k) {
+        if ((asize = heap_asize(BATCH_SIZE(sizes, size, i))) == 0) {
+            k = i + 1;
+            continue;
+        }
+        if ((bp = batch_fit(total, asize, nofit)) == NULL)
+            break;
+        /* the blocks from i on that fit in bp */
+        for (k = i, fill = 0; k < j; k++) {
+            if ((asize = heap_asize(BATCH_SIZE(sizes, size, k))) == 0)
+                continue;
+            if (fill + asize > GET_SIZE(HDRP(bp)))
+                break;
+            fill += asize;
+        }
+        total -= fill;
+        place(bp, fill);
+        fill = GET_SIZE(HDRP(bp));      /* place keeps a tail too small to split */
+        prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+        user_malloc_size -= fill - TSIZE;   /* counted again block by block */
+        for (; i < k; i++) {
+            if ((asize = heap_asize(BATCH_SIZE(sizes, size, i))) == 0)
+                continue;
+            if (fill - asize < MIN_BLK_SIZE)
+                asize = fill;           /* the last block takes that tail */
+            PUT(HDRP(bp), PACK(asize, prev_alloc, 1));
+            ptrs[i] = bp;
+            user_malloc_size += asize - TSIZE;
+            bp += asize;
+            fill -= asize;
+            prev_alloc = 1;
+            done++;
+        }
+    }
+    for (; i < j; i++)
+        if (heap_asize(BATCH_SIZE(sizes, size, i)) != 0)
+            ptrs[i] = NULL;
+    return done;
+}
+
+/*
+ * mm_malloc_batch - allocate n blocks of size bytes into ptrs[0..n). Blocks
+ *     that cannot be allocated are NULL; returns how many were. Faster than
+ *     n calls to mm_malloc for sizes the heap serves (see BATCH_RUN_MAX).
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    return malloc_batch(NULL, size, n, ptrs);
+}
+
+/*
+ * mm_malloc_batch_sizes - like mm_malloc_batch, ptrs[i] gets sizes[i] bytes
+ */
+size_t mm_malloc_batch_sizes(const size_t *sizes, size_t n, void **ptrs)
+{
+    return malloc_batch(sizes, 0, n, ptrs);
+}
+
+/*
+ * mm_memalign - allocate size bytes aligned to alignment, a power of 2.
+ *     The free block is carved around the aligned payload (memalign_block),
+ *     so only the slack that cannot form a free block of its own is lost.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    size_t asize;
+    char *bp;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= ALIGNMENT)
+        return mm_malloc(size);
+    CHECK_SAMPLE();
+    if (size == 0)
+        return NULL;
+    STAT_INC(mallocs);
+#if MMAP
+    if (size >= mmap_threshold)
+        return PROF_MALLOC(mmap_block(size, alignment), size);
+#endif
+    if (size > MAX_BLK_SIZE)
+        return NULL;
+    asize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
+    LOCK();
+    bp = memalign_block(alignment, asize);
+    UNLOCK();
+    return PROF_MALLOC(bp, size);
+}
+
+/*
+ * malloc_block - find or make room for a block of asize bytes and place it.
+ *     If zero is not NULL, *zero is set when the free block it came from was
+ *     marked ZERO_BIT. The caller holds heap_lock in thread-safe mode.
+ */
+static void *malloc_block(size_t asize, int *zero)
+{
+    size_t extend_size;     /* Amount to extend head if not fit */
+    char *bp;
+
+#if DEFER
+    if (asize <= QUICK_MAX_SIZE && (bp = quick_get(asize)) != NULL)
+        return bp;
+#endif
+    /* Search the free list for a fit */
+    bp = find_fit(asize);
+#if DEFER
+    if (bp == NULL && quick_bytes != 0) {
+        consolidate();
+        bp = find_fit(asize);
+    }
+#endif
+    if (bp != NULL)
+    {
+        // mm_check(__FUNCTION__, bp);
+        if (zero != NULL)
+            *zero = IS_ZERO(bp) != 0;
+        place(bp, asize);
+        // user_malloc_size += size; // Add the user-requested size
+        return bp;
+    }
+    /*no fit found.*/
+    extend_size = MAX(asize, CHUNKSIZE);
+    if ((bp = extend_heap(extend_size / WSIZE)) == NULL)
+    {
+        return NULL;
+    }
+    if (zero != NULL)
+        *zero = IS_ZERO(bp) != 0;
+    place(bp, asize);
+    // user_malloc_size += size; // Add the user-requested size
+    return bp;
+}
+
+/*
+ * memalign_block - like malloc_block, but the payload is aligned to align,
+ *     a power of 2 above ALIGNMENT. Takes a free block with room for the
+ *     worst slack, returns the slack in front of the aligned payload to the
+ *     free list as a block of its own and lets place split off the tail.
+ */
+static void *memalign_block(size_t align, size_t asize)
+{
+    size_t need = asize + align + MIN_BLK_SIZE;
+    size_t size, lead, prev_alloc;
+    char *bp, *p;
+
+    if (asize > MAX_BLK_SIZE || align > MAX_BLK_SIZE - asize - MIN_BLK_SIZE)
+        return NULL;
+    bp = find_fit(need);
+#if DEFER
+    if (bp == NULL && quick_bytes != 0) {
+        consolidate();
+        bp = find_fit(need);
+    }
+#endif
+    if (bp == NULL && (bp = extend_heap(MAX(need, CHUNKSIZE) / WSIZE)) == NULL)
+        return NULL;
+
+    // 对齐后前面剩下的部分要能单独成为一个空闲块
+    p = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    while (p != bp && p - bp < MIN_BLK_SIZE)
+        p += align;
+    if (p != bp) {
+        STAT_INC(splits);
+        size = GET_SIZE(HDRP(bp));
+        prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+        lead = p - bp;
+        delete_from_free_list(bp);
+        PUT(HDRP(bp), PACK(lead, prev_alloc, 0));
+        PUT(FTRP(bp), PACK(lead, prev_alloc, 0));
+        add_to_free_list(bp);
+        PUT(HDRP(p), PACK(size - lead, 0, 0));
+        PUT(FTRP(p), PACK(size - lead, 0, 0));
+        add_to_free_list(p);
+    }
+    place(p, asize);
+    return p;
+}
+
+/*
+ * mm_free - Freeing a block does nothing.
+ */
+void mm_free(void *bp)
+{
+    CHECK_SAMPLE();
+    if (bp == NULL)
+        return;
+    STAT_INC(frees);
+    PROF_FREE(bp);
+
+    if (free_unlocked(bp) == 0)
+        return;
+    LOCK();
+    free_block(bp);
+    UNLOCK();
+}
+
+/*
+ * mm_free_sized - mm_free for a block last allocated or reallocated with
+ *     size bytes. A heap block small enough for the tcache goes there by
+ *     size, without reading its head (THREAD_SAFE=1); without the tcache
+ *     it is just mm_free. HEAP_CHECK=1 checks size against the block and
+ *     aborts if it cannot be right.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+#if THREAD_SAFE
+    int idx;
+#endif
+
+    if (bp == NULL)
+        return;
+#if HEAP_CHECK
+    if (!check_size(bp, size)) {
+        fprintf(stderr, "mm_free_sized: block %p of %zu usable bytes freed with size %zu\n",
+                bp, mm_usable_size(bp), size);
+        abort();
+    }
+#endif
+#if THREAD_SAFE
+    if ((idx = sized_bin(bp, size)) >= 0) {
+        CHECK_SAMPLE();
+        STAT_INC(frees);
+        PROF_FREE(bp);
+        tcache_put(idx, bp);
+        return;
+    }
+#endif
+    mm_free(bp);
+}
+
+#if THREAD_SAFE
+/*
+ * sized_bin - the tcache bin of a heap block allocated with size bytes,
+ *     found without reading its head, or -1 if mm_free has to look. The
+ *     block may be bigger than the bin size (place and realloc leave tails
+ *     under MIN_BLK_SIZE), never smaller, so the bin can hand it out again.
+ */
+static int sized_bin(void *bp, size_t size)
+{
+    size_t asize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
+
+    if (asize > TCACHE_MAX_SIZE)
+        return -1;
+#if MMAP
+    if (size >= mmap_min_threshold)
+        return -1;
+#endif
+#if SLAB
+    if (slab_owns(bp))
+        return -1;
+#endif
+#if HEAPS
+    if (heap_of(bp) != thread_heap())
+        return -1;
+#endif
+    return TCACHE_IDX(asize);
+}
+#endif
+
+/*
+ * mm_free_batch - free the n blocks of ptrs, NULL entries are skipped
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    void *heap[BATCH_FREE_MAX];
+    size_t i, k = 0, nfree = 0;
+
+    CHECK_SAMPLE();
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] == NULL)
+            continue;
+        nfree++;
+        PROF_FREE(ptrs[i]);
+        if (free_unlocked(ptrs[i]) == 0)
+            continue;
+        heap[k++] = ptrs[i];
+        if (k == BATCH_FREE_MAX) {
+            free_blocks(heap, k);
+            k = 0;
+        }
+    }
+    free_blocks(heap, k);
+    STAT_ADD(frees, nfree);
+}
+
+/*
+ * free_blocks - free_block the n blocks of bps under one lock
+ */
+static void free_blocks(void **bps, size_t n)
+{
+    size_t i;
+
+    if (n == 0)
+        return;
+    LOCK();
+    for (i = 0; i < n; i++)
+        free_block(bps[i]);
+    UNLOCK();
+}
+
+/*
+ * free_unlocked - free bp if it goes back without heap_lock: a slab
+ *     object, a mapped block, a block of another heap or one for the
+ *     tcache. Returns 0 if it did, -1 if the caller must free_block bp.
+ */
+static int free_unlocked(void *bp)
+{
+#if THREAD_SAFE
+    size_t size;
+#endif
+#if HEAPS
+    struct mm_heap *owner;
+#endif
+
+#if SLAB
+    if (slab_owns(bp)) {
+#if THREAD_SAFE
+        tcache_put(TCACHE_SLAB_IDX(slab_size(bp)), bp);
+#else
+        slab_free_block(bp);
+#endif
+        return 0;
+    }
+#endif
+#if MMAP
+    if (IS_MMAPPED(bp)) {
+        munmap_block(bp);
+        return 0;
+    }
+#endif
+#if HEAPS
+    if ((owner = heap_of(bp)) != thread_heap()) {
+        remote_free(owner, bp);
+        return 0;
+    }
+#endif
+#if THREAD_SAFE
+    size = GET_SIZE(HDRP(bp));
+    if (size <= TCACHE_MAX_SIZE) {
+        tcache_put(TCACHE_IDX(size), bp);
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * free_block - give the allocated block bp back to the heap: onto a quick
+ *     list with DEFER=1 if it is small, else merge_block.
+ *     The caller holds heap_lock in thread-safe mode.
+ */
+static void free_block(void *bp)
+{
+#if DEFER
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size <= QUICK_MAX_SIZE) {
+        quick_put(bp, size);
+        return;
+    }
+#endif
+    merge_block(bp);
+}
+
+/*
+ * merge_block - mark bp free and coalesce it into the free lists.
+ *     The caller holds heap_lock in thread-safe mode.
+ */
+static void merge_block(void *bp)
+{
+    // get utilization
+    size_t block_size = GET_SIZE(HDRP(bp));
+    user_malloc_size -= block_size - TSIZE; // Subtract user space (block size minus header)
+
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    void *head_next_bp = NULL;
+#if TRIM
+    /* the range whose pages may still be dirty: bp and small free neighbours */
+    char *lo = bp, *hi = (char *)bp + size;
+    void *next_bp = NEXT_BLKP(bp);
+
+    if (!prev_alloc && GET_SIZE((char *)bp - 2 * TSIZE) < RELEASE_THRESHOLD)
+        lo = PREV_BLKP(bp);
+    if (!GET_ALLOC(HDRP(next_bp)) && GET_SIZE(HDRP(next_bp)) < RELEASE_THRESHOLD)
+        hi = (char *)next_bp + GET_SIZE(HDRP(next_bp));
+#endif
+
+    PUT(HDRP(bp), PACK(size, prev_alloc, 0));
+    PUT(FTRP(bp), PACK(size, prev_alloc, 0));
+    // mm_check(__FUNCTION__, bp);
+
+     /*notify next_block, i am free*/
+    head_next_bp = HDRP(NEXT_BLKP(bp));
+    PUT(head_next_bp, PACK_PREV_ALLOC(GET(head_next_bp), 0));
+
+    bp = coalesce(bp);
+#if TRIM
+    trim_block(bp, lo, hi);
+#endif
+}
+
+/*
+ * mm_usable_size - the bytes usable at bp, at least as many as requested
+ */
+size_t mm_usable_size(void *bp)
+{
+    if (bp == NULL)
+        return 0;
+#if SLAB
+    if (slab_owns(bp))
+        return slab_size(bp);
+#endif
+#if MMAP
+    if (IS_MMAPPED(bp))
+        return MMAP_PAYLOAD(bp);
+#endif
+    return GET_SIZE(HDRP(bp)) - TSIZE;  /* allocated blocks have no foot */
+}
+
+/*
+ * mm_realloc - Resize the block in place when it can (see realloc_in_place),
+ *     otherwise fall back to mm_malloc + memcpy + mm_free.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *oldptr = ptr;
+    void *newptr;
+    size_t asize;
+    size_t copySize;
+    int done;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    /* only a real resize counts, the cases above are a malloc or a free */
+    CHECK_SAMPLE();
+    STAT_INC(reallocs);
+#if !MMAP
+    if (size > MAX_BLK_SIZE)
+        return NULL;
+#endif
+    asize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
+
+#if SLAB
+    if (slab_owns(oldptr)) {
+        /* a slot cannot grow, but it can keep anything up to its size */
+        copySize = slab_size(oldptr);
+        if (size <= copySize) {
+            PROF_REALLOC(oldptr, oldptr, size);
+            return oldptr;
+        }
+    } else
+#endif
+#if MMAP
+    if (IS_MMAPPED(oldptr)) {
+        if (size >= mmap_threshold) {
+            if ((newptr = mremap_block(oldptr, size)) != NULL)
+                PROF_REALLOC(oldptr, newptr, size);
+            return newptr;
+        }
+        copySize = MMAP_PAYLOAD(oldptr);
+    } else if (size >= mmap_threshold) {
+        /* big enough to leave the heap for a mapping of its own */
+        copySize = GET_SIZE(HDRP(oldptr)) - TSIZE;
+    } else
+#endif
+    {
+        LOCK_OWNER(oldptr);
+        done = realloc_in_place(oldptr, asize);
+        UNLOCK();
+        if (done) {
+            PROF_REALLOC(oldptr, oldptr, size);
+            return oldptr;
+        }
+        copySize = GET_SIZE(HDRP(oldptr)) - TSIZE;  /* payload only, no header */
+    }
+
+    newptr = mm_malloc(size);
+    if (newptr == NULL)
+        return NULL;
+    if (size < copySize)
+        copySize = size;
+    memcpy(newptr, oldptr, copySize);
+    mm_free(oldptr);
+    return newptr;
+}
+
+/*
+ * realloc_in_place - try to make the allocated block bp exactly asize bytes
+ *     without moving it. Returns 1 on success, 0 if the caller has to copy.
+ *       - growing absorbs a free next block; when bp is the last block (or is
+ *         only followed by a free last block) the heap is extended first;
+ *       - any tail of at least MIN_BLK_SIZE bytes is split off and freed.
+ *     The caller holds heap_lock in thread-safe mode.
+ */
+static int realloc_in_place(void *bp, size_t asize)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    void *next_bp = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next_bp)) ? 0 : GET_SIZE(HDRP(next_bp));
+    void *tail_bp;
+
+    if (asize > size) {
+        int at_end = IS_LAST_BLK(bp) || (next_size != 0 && IS_LAST_BLK(next_bp));
+
+        if (size + next_size < asize) {
+            if (!at_end)
+                return 0;
+            /* extend_heap coalesces the new space with a free last block */
+            if (extend_heap(MAX(asize - size - next_size, CHUNKSIZE) / WSIZE) == NULL)
+                return 0;
+            next_bp = NEXT_BLKP(bp);
+            if (GET_ALLOC(HDRP(next_bp)) || size + GET_SIZE(HDRP(next_bp)) < asize)
+                return 0;
+        }
+        next_size = GET_SIZE(HDRP(next_bp));
+
+        delete_from_free_list(next_bp);
+        size += next_size;
+        user_malloc_size += next_size;
+        PUT(HDRP(bp), PACK(size, prev_alloc, 1));
+
+        /*notify next_block, i am allocated*/
+        next_bp = NEXT_BLKP(bp);
+        PUT(HDRP(next_bp), PACK_PREV_ALLOC(GET(HDRP(next_bp)), 1));
+    }
+
+    if (size - asize >= MIN_BLK_SIZE) {
+        STAT_INC(splits);
+        PUT(HDRP(bp), PACK(asize, prev_alloc, 1));
+        user_malloc_size -= size - asize;
+
+        tail_bp = NEXT_BLKP(bp);
+        PUT(HDRP(tail_bp), PACK(size - asize, 1, 0));
+        PUT(FTRP(tail_bp), PACK(size - asize, 1, 0));
+        next_bp = NEXT_BLKP(tail_bp);
+        PUT(HDRP(next_bp), PACK_PREV_ALLOC(GET(HDRP(next_bp)), 0));
+        coalesce(tail_bp);
+    }
+    return 1;
+}
+
+/*
+ * put_sentinels - lay out padding, prologue and epilogue in the 4 * TSIZE
+ *     bytes at p, the start of an arena. Returns the prologue (heap_listp).
+ */
+static char *put_sentinels(char *p)
+{
+    // 填充 + 序言块(头、脚) + 结尾块，第一个块的有效载荷从 16 字节处开始，满足对齐
+    PUT(p, 0);     // 0 表示空闲块，1 表示分配块
+    PUT(p + (1 * TSIZE), PACK(2 * TSIZE, 1, 1));
+    PUT(p + (2 * TSIZE), PACK(2 * TSIZE, 1, 1));
+    PUT(p + (3 * TSIZE), PACK(0, 1, 1));
+    return p + (2 * TSIZE);
+}
+
+/*
+ * arena_first_block - the first block of the arena whose used part is
+ *     [lo, hi): right after the sentinels, which in the very first arena
+ *     may come after the segregated list heads.
+ */
+static char *arena_first_block(char *lo, char *hi)
+{
+    if (heap_listp >= lo && heap_listp < hi)
+        return heap_listp + 2 * TSIZE;
+    return lo + 4 * TSIZE;
+}
+
+/*
+ * stats_walk - add the free blocks of the current heap to st. The caller
+ *     holds heap_lock.
+ */
+static void stats_walk(struct mm_stats *st)
+{
+    char *lo, *hi, *bp;
+    size_t size;
+    int i, bin;
+
+    for (i = 0; mem_arena_range(i, &lo, &hi) == 0; i++) {
+        for (bp = arena_first_block(lo, hi); (size = GET_SIZE(HDRP(bp))) != 0; bp = NEXT_BLKP(bp)) {
+            if (GET_ALLOC(HDRP(bp)))
+                continue;
+            st->free_blocks++;
+            st->free_bytes += size;
+            st->largest_free = MAX(st->largest_free, size);
+            for (bin = 0; (size >> 1) != 0 && bin < MM_STATS_BINS - 1; bin++)
+                size >>= 1;
+            st->free_hist[bin]++;
+        }
+    }
+}
+
+/*
+ * mm_stats - fill *st, see mm.h. Walks every heap under its lock.
+ */
+void mm_stats(struct mm_stats *st)
+{
+#if HEAPS
+    int i;
+#endif
+
+    memset(st, 0, sizeof(*st));
+#if MM_STATS
+    st->mallocs = stats.mallocs;
+    st->frees = stats.frees;
+    st->reallocs = stats.reallocs;
+    st->zero_hits = stats.zero_hits;
+    st->fit_steps = stats.fit_steps;
+    st->splits = stats.splits;
+    st->coalesces = stats.coalesces;
+    st->extends = stats.extends;
+    st->consolidations = stats.consolidations;
+    st->fit_cutoffs = stats.fit_cutoffs;
+#endif
+#if HEAPS
+    for (i = 0; i < HEAPS; i++) {
+        heap_enter(&heaps[i]);
+        stats_walk(st);
+        heap_leave();
+    }
+#else
+    LOCK();
+    stats_walk(st);
+    UNLOCK();
+#endif
+    if (st->free_bytes != 0)
+        st->ext_frag = 1.0 - (double)st->largest_free / st->free_bytes;
+}
+
+/*
+ * CHECK - report a failed heap check and make the caller return -1
+ */
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "mm_checkheap: " __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return -1; \
+        } \
+    } while (0)
+
+/*
+ * check_blocks - walk every block of every arena of the current heap and
+ *     count the free ones in *nfree. Checks alignment and sizes, that the
+ *     head and foot of a free block agree, that each prev_alloc bit matches
+ *     the block before and that no two free blocks are neighbours. At
+ *     level 3 also that free blocks marked ZERO_BIT read as zeros.
+ */
+static int check_blocks(int level, size_t *nfree)
+{
+    char *lo, *hi, *bp, *p;
+    size_t size, prev_alloc;
+    int i;
+
+    for (i = 0; mem_arena_range(i, &lo, &hi) == 0; i++) {
+        prev_alloc = 1;     /* the prologue */
+        for (bp = arena_first_block(lo, hi); ; bp = NEXT_BLKP(bp)) {
+            CHECK(bp > lo && bp <= hi, "block %p outside its arena [%p, %p)", bp, lo, hi);
+            CHECK(GET_PREV_ALLOC(HDRP(bp)) == prev_alloc,
+                  "block %p: prev_alloc bit is %zu, the block before is %s",
+                  bp, (size_t)GET_PREV_ALLOC(HDRP(bp)), prev_alloc ? "allocated" : "free");
+            if ((size = GET_SIZE(HDRP(bp))) == 0)
+                break;      /* the epilogue */
+            CHECK((size_t)bp % ALIGNMENT == 0, "block %p is not aligned", bp);
+            CHECK(size % ALIGNMENT == 0 && size >= MIN_BLK_SIZE, "block %p: bad size %zu", bp, size);
+            if (!GET_ALLOC(HDRP(bp))) {
+                CHECK(prev_alloc, "free block %p follows another free block", bp);
+                CHECK(GET_SIZE(FTRP(bp)) == size && !GET_ALLOC(FTRP(bp)),
+                      "free block %p: head says %zu bytes, foot %zu", bp, size, GET_SIZE(FTRP(bp)));
+                if (level >= 3 && IS_ZERO(bp))
+                    for (p = bp + 2 * WSIZE; p < FTRP(bp); p++)
+                        CHECK(*p == 0, "free block %p marked zero has byte %d at %p", bp, *p, p);
+                (*nfree)++;
+            }
+            prev_alloc = GET_ALLOC(HDRP(bp));
+        }
+        CHECK(bp == hi, "epilogue at %p, arena [%p, %p)", bp, lo, hi);
+    }
+    return 0;
+}
+
+/*
+ * check_list - check the free list starting at bp, the idx-th segregated
+ *     list: every block is free, in the right class and linked both ways.
+ *     Adds the blocks seen to *nlisted and stops past limit (a cycle).
+ */
+static int check_list(char *bp, int idx, size_t *nlisted, size_t limit)
+{
+    char *pred = NULL;
+
+    for (; bp != NULL; pred = bp, bp = (char *)GET_SUCC(bp)) {
+        CHECK(++*nlisted <= limit, "more blocks on the free lists than free in the heap");
+        CHECK(!GET_ALLOC(HDRP(bp)), "allocated block %p on free list %d", bp, idx);
+        CHECK((char *)GET_PRED(bp) == pred, "block %p on free list %d: pred %p, expected %p",
+              bp, idx, (char *)GET_PRED(bp), pred);
+#if SEG_LIST
+        CHECK(seg_index(GET_SIZE(HDRP(bp))) == idx, "block %p of %zu bytes on free list %d",
+              bp, GET_SIZE(HDRP(bp)), idx);
+#endif
+#if TREE_FIT
+        CHECK(GET_SIZE(HDRP(bp)) < TREE_MIN_SIZE, "block %p of %zu bytes on a list, not in the tree",
+              bp, GET_SIZE(HDRP(bp)));
+#endif
+    }
+    return 0;
+}
+
+#if TREE_FIT
+/*
+ * check_tree - check the subtree t, whose keys must lie between lo and hi
+ *     (NULL: unbounded) and whose priorities must not exceed prio.
+ */
+static int check_tree(char *t, char *lo, char *hi, unsigned int prio, size_t *nlisted, size_t limit)
+{
+    if (t == NULL)
+        return 0;
+    CHECK(++*nlisted <= limit, "more blocks in the tree than free in the heap");
+    CHECK(!GET_ALLOC(HDRP(t)), "allocated block %p in the tree", t);
+    CHECK(GET_SIZE(HDRP(t)) >= TREE_MIN_SIZE, "block %p of %zu bytes in the tree", t, GET_SIZE(HDRP(t)));
+    CHECK((lo == NULL || TREE_LESS(lo, t)) && (hi == NULL || TREE_LESS(t, hi)),
+          "tree node %p out of order", t);
+    CHECK(TREE_PRIO(t) <= prio, "tree node %p has a higher priority than its parent", t);
+    if (check_tree(LEFT(t), lo, t, TREE_PRIO(t), nlisted, limit) < 0)
+        return -1;
+    return check_tree(RIGHT(t), t, hi, TREE_PRIO(t), nlisted, limit);
+}
+#endif
+
+#if DEFER
+/*
+ * check_quick - check the quick lists: every block is still allocated and
+ *     has the size of its list, and together they hold quick_bytes.
+ */
+static int check_quick(void)
+{
+    size_t bytes = 0;
+    char *bp;
+    int idx;
+
+    for (idx = 0; idx < QUICK_BINS; idx++) {
+        for (bp = quick_heads[idx]; bp != NULL; bp = QUICK_NEXT(bp)) {
+            CHECK(GET_ALLOC(HDRP(bp)), "free block %p on quick list %d", bp, idx);
+            CHECK(GET_SIZE(HDRP(bp)) == MIN_BLK_SIZE + (size_t)idx * ALIGNMENT,
+                  "block %p of %zu bytes on quick list %d", bp, GET_SIZE(HDRP(bp)), idx);
+            bytes += GET_SIZE(HDRP(bp));
+            CHECK(bytes <= quick_bytes, "more than %zu bytes on the quick lists", quick_bytes);
+        }
+    }
+    CHECK(bytes == quick_bytes, "%zu bytes on the quick lists, %zu counted", bytes, quick_bytes);
+    return 0;
+}
+#endif
+
+/*
+ * check_heap - check the current heap, see mm_checkheap. The caller holds
+ *     its lock.
+ */
+static int check_heap(int level)
+{
+    size_t nfree = 0, nlisted = 0;
+    char *bp;
+#if SEG_LIST
+    int idx;
+#endif
+
+    if (level <= 0)
+        return 0;
+    if (check_blocks(level, &nfree) < 0)
+        return -1;
+    if (level < 2)
+        return 0;
+#if SEG_LIST
+    for (idx = 0; idx < SEG_NUM; idx++)
+        if (check_list(seg_listp[idx], idx, &nlisted, nfree) < 0)
+            return -1;
+#else
+    if (check_list(free_listp, 0, &nlisted, nfree) < 0)
+        return -1;
+#endif
+#if TREE_FIT
+    if (check_tree(tree_root, NULL, NULL, UINT_MAX, &nlisted, nfree) < 0)
+        return -1;
+#endif
+    CHECK(nlisted == nfree, "%zu free blocks in the heap, %zu on the free lists", nfree, nlisted);
+    if (rover != NULL) {
+        for (bp = LIST_HEAD(GET_SIZE(HDRP(rover))); bp != NULL && bp != rover; bp = (char *)GET_SUCC(bp))
+            ;
+        CHECK(bp == rover, "next fit rover %p is not on a free list", rover);
+    }
+#if DEFER
+    if (check_quick() < 0)
+        return -1;
+#endif
+    return 0;
+}
+
+/*
+ * mm_checkheap - check every heap, see mm.h. Returns 0 if all is well,
+ *     otherwise prints the first problem found and returns -1.
+ */
+int mm_checkheap(int level)
+{
+    int ret;
+#if HEAPS
+    int i;
+
+    for (i = 0, ret = 0; i < HEAPS && ret == 0; i++) {
+        heap_enter(&heaps[i]);
+        ret = check_heap(level);
+        heap_leave();
+    }
+#else
+    LOCK();
+    ret = check_heap(level);
+    UNLOCK();
+#endif
+    return ret;
+}
+
+#if HEAP_CHECK
+/*
+ * check_size - whether size bytes can be what the allocated block bp was
+ *     last asked for: a heap block is within one split (MIN_BLK_SIZE) of
+ *     the block size size needs, a mapping within a page.
+ */
+static int check_size(void *bp, size_t size)
+{
+    size_t asize = MAX(MIN_BLK_SIZE, ALIGN((size + TSIZE)));
+
+#if SLAB
+    if (slab_owns(bp))
+        return size <= slab_size(bp);
+#endif
+#if MMAP
+    if (IS_MMAPPED(bp))
+        return size >= mmap_min_threshold && size <= MMAP_PAYLOAD(bp) &&
+               MMAP_PAYLOAD(bp) - size < mem_pagesize();
+#endif
+    return asize <= GET_SIZE(HDRP(bp)) && GET_SIZE(HDRP(bp)) < asize + MIN_BLK_SIZE;
+}
+
+/*
+ * check_sample - count one call and check the heap if it is the
+ *     check_every-th
+ */
+static void check_sample(void)
+{
+    unsigned long n;
+
+    if (check_every == 0)
+        return;
+#if THREAD_SAFE
+    n = __atomic_add_fetch(&check_ops, 1, __ATOMIC_RELAXED);
+#else
+    n = ++check_ops;
+#endif
+    if (n % check_every == 0 && mm_checkheap(check_level) < 0)
+        abort();
+}
+#endif
+
+static void *extend_heap(size_t words)
+{
+    char *bp;
+    size_t size;
+    size_t prev_alloc;
+    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+
+    if ((long)(bp = mem_sbrk(size)) == -1) {
+        /* the current arena is full: go on in a new one */
+        if ((long)(bp = mem_new_arena(4 * TSIZE + size)) == -1)
+            return NULL;
+        put_sentinels(mem_sbrk(4 * TSIZE));
+        bp = mem_sbrk(size);
+    }
+    /*the old epilogue becomes the head of the new block*/
+    prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    STAT_INC(extends);
+
+    // get utilization
+    heap_size += size; // Add the extended heap size
+
+    PUT(HDRP(bp), PACK(size, prev_alloc, 0) | ZERO_BIT); /*last free block, fresh zeros*/
+    PUT(FTRP(bp), PACK(size, prev_alloc, 0));
+
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /*break block*/
+    return coalesce(bp);
+}
+
+#if TRIM
+/*
+ * trim_block - give the memory of the just coalesced free block bp back to
+ *     the kernel: shrink the heap if bp is its last block, else release the
+ *     pages of [lo, hi) inside bp. The caller holds heap_lock.
+ */
+static void trim_block(void *bp, char *lo, char *hi)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t decr;
+    char *start, *end;
+    int whole;
+
+    if (IS_LAST_BLK(bp) && size >= TRIM_THRESHOLD) {
+        decr = size - TRIM_KEEP;
+        delete_from_free_list(bp);
+        if ((long)mem_trim(decr) == -1) {
+            add_to_free_list(bp);
+            return;
+        }
+        heap_size -= decr;
+        trimmed_size += decr;
+        PUT(HDRP(bp), PACK(TRIM_KEEP, GET_PREV_ALLOC(HDRP(bp)), 0) | IS_ZERO(bp));
+        PUT(FTRP(bp), PACK(TRIM_KEEP, GET_PREV_ALLOC(HDRP(bp)), 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /*break block*/
+        add_to_free_list(bp);
+        return;
+    }
+    if (size >= RELEASE_THRESHOLD) {
+        start = (char *)bp + 2 * WSIZE;
+        end = FTRP(bp);
+        whole = lo <= start && hi >= end;   /* no big neighbour merged in */
+        /* one more page each side: the pages shared with a big neighbour */
+        lo -= mem_pagesize();
+        hi += mem_pagesize();
+        /* keep the header, the list/tree links and the footer */
+        lo = MAX(lo, start);
+        hi = MIN(hi, end);
+        if (lo < hi)
+            released_size += mem_release(lo, hi - lo);
+        if (whole) {
+            /* all of bp was dirty and is released: clear the partial pages
+               at both ends, then it reads as zeros (ZERO_BIT) */
+            lo = (char *)(((uintptr_t)start + mem_pagesize() - 1) & ~(uintptr_t)(mem_pagesize() - 1));
+            hi = (char *)((uintptr_t)end & ~(uintptr_t)(mem_pagesize() - 1));
+            memset(start, 0, MIN(lo, end) - start);
+            if (hi > lo)
+                memset(hi, 0, end - hi);
+            PUT(HDRP(bp), GET(HDRP(bp)) | ZERO_BIT);
+        }
+    }
+}
+#endif
 
-     /*notify next_block, i am free*/
-    head_next_bp = HDRP(NEXT_BLKP(bp));
-    PUT(head_next_bp, PACK_PREV_ALLOC(GET(head_next_bp), 0));
+#if MMAP
+/*
+ * mmap_length - the mapping length that holds size payload bytes,
+ *     0 if that overflows
+ */
+static size_t mmap_length(size_t size)
+{
+    size_t page = mem_pagesize();
 
-    coalesce(bp);
+    if (size > SIZE_MAX - DSIZE - page)
+        return 0;
+    return (size + DSIZE + page - 1) & ~(page - 1);
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mmap_block - map a block of its own for size bytes, its payload aligned
+ *     to align (a power of 2, at least DSIZE). Maps align bytes more and
+ *     unmaps the whole pages around the aligned block. Mapped bytes count
+ *     as heap_size, the payload as user_malloc_size.
  */
-void *mm_realloc(void *ptr, size_t size)
+static void *mmap_block(size_t size, size_t align)
 {
-    void *oldptr = ptr;
-    void *newptr;
-    size_t copySize;
+    size_t len = size <= SIZE_MAX - align ? mmap_length(size + (align > DSIZE ? align : 0)) : 0;
+    size_t keep;
+    char *base, *start, *bp;
 
-    newptr = mm_malloc(size);
-    if (newptr == NULL)
+    if (len == 0)
         return NULL;
-    copySize = *(size_t *)((char *)oldptr - SIZE_T_SIZE);
-    if (size < copySize)
-        copySize = size;
-    memcpy(newptr, oldptr, copySize);
-    mm_free(oldptr);
-    return newptr;
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    bp = (char *)(((uintptr_t)base + DSIZE + align - 1) & ~(uintptr_t)(align - 1));
+    start = MMAP_BASE(bp);
+    keep = mmap_length(bp - DSIZE - start + size);
+    if (start > base)
+        munmap(base, start - base);
+    if (start + keep < base + len)
+        munmap(start + keep, base + len - (start + keep));
+    MMAP_LEN(bp) = keep;
+    PUT(HDRP(bp), PACK(0, 1, 1) | MMAP_BIT);
+
+    LOCK();
+    user_malloc_size += MMAP_PAYLOAD(bp);
+    heap_size += keep;
+    UNLOCK();
+    return bp;
 }
 
-static void *extend_heap(size_t words)
+static void munmap_block(void *bp)
 {
-    /*get heap_brk*/
-    char *old_heap_brk = mem_sbrk(0);
-    size_t prev_alloc = GET_PREV_ALLOC(HDRP(old_heap_brk));
+    size_t len = MMAP_LEN(bp);
 
-    /*printf("\nin extend_heap prev_alloc=%u\n", prev_alloc);*/
-    char *bp;
-    size_t size;
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    LOCK();
+    user_malloc_size -= MMAP_PAYLOAD(bp);
+    heap_size -= len;
+    UNLOCK();
+    munmap(MMAP_BASE(bp), len);
+}
 
-    if ((long)(bp = mem_sbrk(size)) == -1)
-        return NULL;
+/*
+ * mremap_block - resize a mapped block; the kernel moves the pages
+ *     instead of copying them if the mapping cannot grow where it is.
+ *     The payload keeps its offset into the first page.
+ */
+static void *mremap_block(void *bp, size_t size)
+{
+    size_t oldlen = MMAP_LEN(bp);
+    size_t off = (char *)bp - MMAP_BASE(bp);
+    size_t len = mmap_length(off - DSIZE + size);
+    char *base;
 
-    // get utilization
-    heap_size += size; // Add the extended heap size
+    if (len == 0)
+        return NULL;
+    if (len == oldlen)
+        return bp;
+    base = mremap(MMAP_BASE(bp), oldlen, len, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+        return NULL;
+    bp = base + off;
+    MMAP_LEN(bp) = len;
 
-    PUT(HDRP(bp), PACK(size, prev_alloc, 0)); /*last free block*/
-    PUT(FTRP(bp), PACK(size, prev_alloc, 0));
+    LOCK();
+    user_malloc_size += len - oldlen;   /* wraps correctly when shrinking */
+    heap_size += len - oldlen;
+    UNLOCK();
+    return bp;
+}
+#endif
 
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 0, 1)); /*break block*/
-    return coalesce(bp);
+/*
+ * clear_tags - zero the foot of free block bp, the head of the free block
+ *     after it and that block's links, once the two are merged into one
+ *     ZERO_BIT block. Returns ZERO_BIT.
+ */
+static size_t clear_tags(void *bp)
+{
+    memset(FTRP(bp), 0, 2 * TSIZE + 2 * WSIZE);
+    return ZERO_BIT;
 }
 
 static void *coalesce(void *bp)
@@ -243,6 +1958,7 @@ static void *coalesce(void *bp)
     size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
+    size_t zero = IS_ZERO(bp);  /* merged blocks stay zero if all parts are */
     /*
         TODO:
             将 bp 指向的空闲块 与 相邻块合并
@@ -254,7 +1970,7 @@ static void *coalesce(void *bp)
     if (prev_alloc && next_alloc) /* 前后都是已分配的块 */
     {
         // 修改头部、脚部； add_to_free_list() 添加到空闲链表(设置前驱和后继)
-        PUT(HDRP(bp), PACK(size, prev_alloc, 0));
+        PUT(HDRP(bp), PACK(size, prev_alloc, 0) | zero);
         PUT(FTRP(bp), PACK(size, prev_alloc, 0));
         add_to_free_list(bp);
     }
@@ -267,10 +1983,12 @@ static void *coalesce(void *bp)
 
         size_t next_alloc_size = GET_SIZE(HDRP(NEXT_BLKP(bp)));
         // char *next_FTRP = FTRP(bp) + next_alloc_size;
+        STAT_INC(coalesces);
 
         delete_from_free_list(NEXT_BLKP(bp));   // 删除旧的空闲链表
+        zero = zero && IS_ZERO(NEXT_BLKP(bp)) ? clear_tags(bp) : 0;
         size = size + next_alloc_size;
-        PUT(HDRP(bp), PACK(size, prev_alloc, 0));   // 头部
+        PUT(HDRP(bp), PACK(size, prev_alloc, 0) | zero);   // 头部
         PUT(FTRP(bp), PACK(size, prev_alloc, 0));   // 尾部
         add_to_free_list(bp);
     }
@@ -285,13 +2003,15 @@ static void *coalesce(void *bp)
 
         void *prev_bp = PREV_BLKP(bp);
         size_t prev_size = GET_SIZE(HDRP(prev_bp));
+        STAT_INC(coalesces);
 
         delete_from_free_list(prev_bp);   // 删除旧的空闲链表
+        zero = zero && IS_ZERO(prev_bp) ? clear_tags(prev_bp) : 0;
         bp = prev_bp;              // 更新bp ??
         size = size + prev_size;
 
         prev_alloc = GET_PREV_ALLOC(HDRP(bp));      // 这步需要更新！
-        PUT(HDRP(bp), PACK(size, prev_alloc, 0));   // 头部
+        PUT(HDRP(bp), PACK(size, prev_alloc, 0) | zero);   // 头部
         PUT(FTRP(bp), PACK(size, prev_alloc, 0));   // 尾部
         add_to_free_list(bp);
     }
@@ -303,18 +2023,25 @@ static void *coalesce(void *bp)
         // 修改脚部；
         // add_to_free_list() 添加到空闲链表(设置前驱和后继)
 
-        size_t prev_alloc_size = GET_SIZE(PREV_BLKP(bp) - WSIZE);
-        size_t next_alloc_size = GET_SIZE(NEXT_BLKP(bp) - WSIZE);
+        size_t prev_alloc_size = GET_SIZE(HDRP(PREV_BLKP(bp)));
+        size_t next_alloc_size = GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        STAT_ADD(coalesces, 2);
 
         // 删除旧的空闲链表
         delete_from_free_list(PREV_BLKP(bp));
         delete_from_free_list(NEXT_BLKP(bp));
+        if (zero && IS_ZERO(PREV_BLKP(bp)) && IS_ZERO(NEXT_BLKP(bp))) {
+            clear_tags(bp);             /* before its head goes */
+            clear_tags(PREV_BLKP(bp));
+        } else {
+            zero = 0;
+        }
 
         bp = PREV_BLKP(bp);      // 更新bp ??
         size = size + prev_alloc_size + next_alloc_size;
 
         prev_alloc = GET_PREV_ALLOC(HDRP(bp));      // 这步需要更新！
-        PUT(HDRP(bp), PACK(size, prev_alloc, 0));   // 头部
+        PUT(HDRP(bp), PACK(size, prev_alloc, 0) | zero);   // 头部
         PUT(FTRP(bp), PACK(size, prev_alloc, 0));   // 尾部
         add_to_free_list(bp);
     }
@@ -323,8 +2050,7 @@ static void *coalesce(void *bp)
     return bp;
 }
 
-#if FIRST_FIT
-static void *find_fit_first(size_t asize)
+static void *first_fit_in_list(void *bp, size_t asize)
 {
     /*
         首次匹配算法
@@ -333,10 +2059,8 @@ static void *find_fit_first(size_t asize)
 
         HINT: asize 已经计算了块头部的大小
     */
-    void *bp = free_listp;
-    if(free_listp == NULL)
-        return NULL;
     while (bp != NULL){
+        STAT_INC(fit_steps);
         if(GET_SIZE(HDRP(bp)) >= asize)
             return bp;
         bp = (void *)GET_SUCC(bp);      // 更新为bp的后继
@@ -344,8 +2068,8 @@ static void *find_fit_first(size_t asize)
     return NULL; // 换成实际返回值
 }
 
-#else
-static void* find_fit_best(size_t asize) {
+static void *best_fit_in_list(void *bp, size_t asize)
+{
     /*
         最佳配算法
         TODO:
@@ -353,51 +2077,146 @@ static void* find_fit_best(size_t asize) {
 
         HINT: asize 已经计算了块头部的大小
     */
-    // void *bp = free_listp;
-    // void *best_bp = NULL;
-    // size_t best_size;   // 初值怎么赋值？
-    // char best_flag = 0;    // 辅助变量
-    // if(free_listp == NULL)
-    //     return NULL;
-    // while (bp != NULL){
-    //     if(GET_SIZE(HDRP(bp)) >= asize){
-    //         if(best_flag == 0){
-    //             best_flag = 1;
-    //             best_size = GET_SIZE(HDRP(bp));
-    //             best_bp = bp;
-    //         }
-    //         if(best_size > GET_SIZE(HDRP(bp))) {
-    //             best_size = GET_SIZE(HDRP(bp));
-    //             best_bp = bp;
-    //         }
-    //     }
-    //     bp = (void *)GET_SUCC(bp);
-    // }
-    // return (best_bp); // 换成实际返回值
-    
-    /*------------version 2----------------*/
-    void *bp = free_listp;
     void *best_bp = NULL;
     size_t best_size = 0;  // Initialize to 0 (will be set on first match)
-    
-    if (free_listp == NULL)
-        return NULL;
-        
+
     while (bp != NULL) {
         size_t current_size = GET_SIZE(HDRP(bp));
+        STAT_INC(fit_steps);
         if (current_size >= asize) {
             // First match or better match than previous best
             if (best_bp == NULL || current_size < best_size) {
                 best_bp = bp;
                 best_size = current_size;
             }
+            // Nothing beats an exact fit
+            if (current_size == asize) {
+                if (GET_SUCC(bp))
+                    STAT_INC(fit_cutoffs);
+                break;
+            }
         }
         bp = (void *)GET_SUCC(bp);
     }
-    
+
+    return best_bp;
+}
+
+/*
+    addr_fit_in_list - the fitting block at the lowest address
+*/
+static void *addr_fit_in_list(void *bp, size_t asize)
+{
+    void *fit = NULL;
+
+    for (; bp != NULL; bp = (void *)GET_SUCC(bp)) {
+        STAT_INC(fit_steps);
+        if (GET_SIZE(HDRP(bp)) >= asize && (fit == NULL || (char *)bp < (char *)fit))
+            fit = bp;
+    }
+    return fit;
+}
+
+/*
+    next_fit_in_list - first fit starting at the rover if it is on the list
+    at head, wrapping around to head; the rover stays at the block found.
+*/
+static void *next_fit_in_list(void *head, size_t asize)
+{
+    void *start = head, *bp;
+
+    if (rover != NULL && (void *)LIST_HEAD(GET_SIZE(HDRP(rover))) == head)
+        start = rover;
+    for (bp = start; bp != NULL; bp = (void *)GET_SUCC(bp)) {
+        STAT_INC(fit_steps);
+        if (GET_SIZE(HDRP(bp)) >= asize)
+            return rover = bp;
+    }
+    for (bp = head; bp != start; bp = (void *)GET_SUCC(bp)) {
+        STAT_INC(fit_steps);
+        if (GET_SIZE(HDRP(bp)) >= asize)
+            return rover = bp;
+    }
+    return NULL;
+}
+
+/*
+    good_fit_in_list - the smallest of the first good_fit_depth fitting
+    blocks; one at most good_fit_slack bytes too big ends the search.
+*/
+static void *good_fit_in_list(void *bp, size_t asize)
+{
+    void *best_bp = NULL;
+    size_t size, best_size = 0, slack = good_fit_slack;
+    int fits = 0, depth = good_fit_depth;
+
+    for (; bp != NULL; bp = (void *)GET_SUCC(bp)) {
+        STAT_INC(fit_steps);
+        if ((size = GET_SIZE(HDRP(bp))) < asize)
+            continue;
+        if (best_bp == NULL || size < best_size) {
+            best_bp = bp;
+            best_size = size;
+        }
+        if (size - asize <= slack || ++fits >= depth)
+            break;
+    }
+    if (bp != NULL && GET_SUCC(bp))
+        STAT_INC(fit_cutoffs);
     return best_bp;
 }
+
+/*
+    fit_in_list - search the free list at head by the current fit policy
+*/
+static void *fit_in_list(void *head, size_t asize)
+{
+    switch (fit_policy) {
+    case MM_FIT_FIRST:
+        return first_fit_in_list(head, asize);
+    case MM_FIT_ADDR:
+        return addr_fit_in_list(head, asize);
+    case MM_FIT_NEXT:
+        return next_fit_in_list(head, asize);
+    case MM_FIT_GOOD:
+        return good_fit_in_list(head, asize);
+    default:
+        return best_fit_in_list(head, asize);
+    }
+}
+
+/*
+    find_fit - a free block of at least asize bytes, NULL if there is none
+*/
+static void *find_fit(size_t asize)
+{
+    void *bp = NULL;
+#if SEG_LIST
+    int idx;
+#endif
+
+#if TREE_FIT
+    /* Every block in the tree is larger than any block in the lists. */
+    if (asize >= TREE_MIN_SIZE)
+        return tree_find(asize);
+#endif
+#if SEG_LIST
+    /*
+        Any block in a larger class fits, and the smallest fitting block sits
+        in the lowest class that has one, so every policy stops at the first
+        class with a fit.
+    */
+    for (idx = seg_index(asize); idx < SEG_NUM && bp == NULL; idx++)
+        bp = fit_in_list(seg_listp[idx], asize);
+#else
+    bp = fit_in_list(free_listp, asize);
+#endif
+#if TREE_FIT
+    if (bp == NULL)
+        bp = tree_find(asize);
 #endif
+    return bp;
+}
 
 static void place(void *bp, size_t asize)
 {
@@ -449,6 +2268,7 @@ static void place(void *bp, size_t asize)
     size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t size = GET_SIZE(HDRP(bp));
     size_t free_size = size - asize;
+    size_t zero = IS_ZERO(bp);  // the rest of a zeroed block is still zero
      
 
     // Remove this block from free list in any case
@@ -466,54 +2286,71 @@ static void place(void *bp, size_t asize)
         int next_alloc = GET_ALLOC(HDRP(next_bp));
         PUT(HDRP(next_bp), PACK(next_size, 1, next_alloc));
 
-        user_malloc_size += size - WSIZE;
+        user_malloc_size += size - TSIZE;
     }
     else {
         // Split the block
+        STAT_INC(splits);
         PUT(HDRP(bp), PACK(asize, prev_alloc, 1));
 
         // Create new free block
         void *free_bp = NEXT_BLKP(bp);
-        PUT(HDRP(free_bp), PACK(free_size, 1, 0));  // Set prev_alloc to 1
+        PUT(HDRP(free_bp), PACK(free_size, 1, 0) | zero);  // Set prev_alloc to 1
         PUT(FTRP(free_bp), PACK(free_size, 1, 0));
 
         // Add the new free block to the free list
         add_to_free_list(free_bp);
-        user_malloc_size += asize - WSIZE;
+        user_malloc_size += asize - TSIZE;
     }
 }
 
 static void add_to_free_list(void *bp)
 {
+    char **headp;
+
+#if TREE_FIT
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE) {
+        tree_insert(bp);
+        return;
+    }
+#endif
+    headp = &LIST_HEAD(GET_SIZE(HDRP(bp)));
     /*set pred & succ*/
-    if (free_listp == NULL) /*free_list empty*/
+    if (*headp == NULL) /*free_list empty*/
     {
         SET_PRED(bp, 0);
         SET_SUCC(bp, 0);
-        free_listp = bp;
+        *headp = bp;
     }
     else
     {
         SET_PRED(bp, 0);
-        SET_SUCC(bp, (size_t)free_listp); /*size_t ???*/
-        SET_PRED(free_listp, (size_t)bp);
-        free_listp = bp;
+        SET_SUCC(bp, (size_t)*headp); /*size_t ???*/
+        SET_PRED(*headp, (size_t)bp);
+        *headp = bp;
     }
 }
 
 static void delete_from_free_list(void *bp)
 {
+    char **headp;
     size_t prev_free_bp=0;
     size_t next_free_bp=0;
-    if (free_listp == NULL)
+
+#if TREE_FIT
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE) {
+        tree_delete(bp);
+        return;
+    }
+#endif
+    headp = &LIST_HEAD(GET_SIZE(HDRP(bp)));
+    if (*headp == NULL)
         return;
+    if (bp == rover)
+        rover = (char *)GET_SUCC(bp);
     prev_free_bp = GET_PRED(bp);
     next_free_bp = GET_SUCC(bp);
 
-    if (prev_free_bp == next_free_bp && prev_free_bp != 0)
-    {
-        
-    }
     if (prev_free_bp && next_free_bp) /*11*/
     {
         SET_SUCC(prev_free_bp, GET_SUCC(bp));
@@ -526,14 +2363,402 @@ static void delete_from_free_list(void *bp)
     else if (!prev_free_bp && next_free_bp) /*01*/
     {
         SET_PRED(next_free_bp, 0);
-        free_listp = (void *)next_free_bp;
+        *headp = (void *)next_free_bp;
     }
     else /*00*/
     {
-        free_listp = NULL;
+        *headp = NULL;
+    }
+}
+
+#if SEG_LIST
+/*
+    seg_index - map a block size to its size class, see the layout comment
+    next to SEG_NUM.
+*/
+static int seg_index(size_t size)
+{
+    size_t s;
+    int lg, idx;
+
+    if (size <= (1 << SEG_MIN_SHIFT))
+        return 0;
+    s = size - 1;
+    lg = 63 - __builtin_clzl(s);                                /* floor(log2(size - 1)) */
+    idx = 2 * (lg - SEG_MIN_SHIFT) + ((s >> (lg - 1)) & 1) + 1; /* lower or upper half */
+    return idx < SEG_NUM ? idx : SEG_NUM - 1;
+}
+#endif
+
+#if DEFER
+/*
+    quick_put - push the allocated block bp of size bytes on its quick list,
+    consolidating once the quick lists are over QUICK_MAX_BYTES.
+*/
+static void quick_put(void *bp, size_t size)
+{
+    int idx = QUICK_IDX(size);
+
+    QUICK_NEXT(bp) = quick_heads[idx];
+    quick_heads[idx] = bp;
+    if ((quick_bytes += size) > QUICK_MAX_BYTES)
+        consolidate();
+}
+
+/*
+    quick_get - pop a block of exactly size bytes from its quick list, NULL
+    if there is none. The block is still marked allocated, nothing to place.
+*/
+static void *quick_get(size_t size)
+{
+    int idx = QUICK_IDX(size);
+    void *bp = quick_heads[idx];
+
+    if (bp != NULL) {
+        quick_heads[idx] = QUICK_NEXT(bp);
+        quick_bytes -= size;
+    }
+    return bp;
+}
+
+/*
+    consolidate - free and coalesce every block on the quick lists.
+*/
+static void consolidate(void)
+{
+    void *bp;
+    int idx;
+
+    STAT_INC(consolidations);
+    for (idx = 0; idx < QUICK_BINS; idx++) {
+        while ((bp = quick_heads[idx]) != NULL) {
+            quick_heads[idx] = QUICK_NEXT(bp);
+            merge_block(bp);
+        }
+    }
+    quick_bytes = 0;
+}
+#endif
+
+#if TREE_FIT
+/*
+    tree_insert - put bp into the treap: walk down by key while the nodes have
+    a higher priority, then split the rest of that subtree around bp.
+*/
+static void tree_insert(void *bp)
+{
+    char **link = &tree_root;
+    char **l, **r;
+    char *t;
+    unsigned int prio = TREE_PRIO(bp);
+
+    while (*link != NULL && TREE_PRIO(*link) >= prio)
+        link = TREE_LESS(bp, *link) ? &LEFT(*link) : &RIGHT(*link);
+
+    t = *link;
+    l = &LEFT(bp);
+    r = &RIGHT(bp);
+    while (t != NULL) {
+        if (TREE_LESS(t, bp)) {
+            *l = t;
+            l = &RIGHT(t);
+            t = RIGHT(t);
+        } else {
+            *r = t;
+            r = &LEFT(t);
+            t = LEFT(t);
+        }
+    }
+    *l = NULL;
+    *r = NULL;
+    *link = bp;
+}
+
+/*
+    tree_delete - unlink bp (its header must still hold the size it was
+    inserted with) and merge its two subtrees in its place.
+*/
+static void tree_delete(void *bp)
+{
+    char **link = &tree_root;
+    char *l, *r;
+
+    while (*link != bp)
+        link = TREE_LESS(bp, *link) ? &LEFT(*link) : &RIGHT(*link);
+
+    l = LEFT(bp);
+    r = RIGHT(bp);
+    while (l != NULL && r != NULL) {
+        if (TREE_PRIO(l) >= TREE_PRIO(r)) {
+            *link = l;
+            link = &RIGHT(l);
+            l = RIGHT(l);
+        } else {
+            *link = r;
+            link = &LEFT(r);
+            r = LEFT(r);
+        }
+    }
+    *link = (l != NULL) ? l : r;
+}
+
+/*
+    tree_find - best fit: the smallest block of at least asize bytes, the
+    lowest address among blocks of that size.
+*/
+static void *tree_find(size_t asize)
+{
+    char *t = tree_root;
+    char *best = NULL;
+
+    while (t != NULL) {
+        STAT_INC(fit_steps);
+        if (GET_SIZE(HDRP(t)) >= asize) {
+            best = t;
+            t = LEFT(t);
+        } else {
+            t = RIGHT(t);
+        }
+    }
+    return best;
+}
+#endif
+
+#if SLAB
+/*
+    slab_malloc_block/slab_free_block - slab objects count as used space by
+    their slot size. The caller holds heap_lock in thread-safe mode.
+*/
+static void *slab_malloc_block(size_t size)
+{
+    void *bp = slab_alloc(size);
+
+    if (bp != NULL)
+        user_malloc_size += size;
+    return bp;
+}
+
+static void slab_free_block(void *bp)
+{
+    user_malloc_size -= slab_size(bp);
+    slab_free(bp);
+}
+
+/*
+    slab_span_alloc/slab_span_free - spans are plain allocated heap blocks,
+    but they only count as used space through the slots handed out of them.
+*/
+static void *slab_span_alloc(size_t size)
+{
+    void *bp = memalign_block(mem_pagesize(), MAX(MIN_BLK_SIZE, ALIGN(size + TSIZE)));
+
+    if (bp != NULL)
+        user_malloc_size -= GET_SIZE(HDRP(bp)) - TSIZE;
+    return bp;
+}
+
+static void slab_span_free(void *bp)
+{
+    user_malloc_size += GET_SIZE(HDRP(bp)) - TSIZE;
+    free_block(bp);
+}
+#endif
+
+#if THREAD_SAFE
+/*
+    tcache_alloc_central/tcache_free_central - where bin idx gets its blocks
+    from and gives them back to. The caller holds heap_lock.
+*/
+static void *tcache_alloc_central(int idx, size_t size)
+{
+#if SLAB
+    if (idx >= TCACHE_HEAP_BINS)
+        return slab_malloc_block(size);
+#endif
+    return malloc_block(size, NULL);
+}
+
+static void tcache_free_central(int idx, void *bp)
+{
+#if SLAB
+    if (idx >= TCACHE_HEAP_BINS) {
+        slab_free_block(bp);
+        return;
+    }
+#endif
+    free_block(bp);
+}
+
+/*
+    tcache_get - pop a cached block of bin idx (blocks of exactly asize
+    bytes), refilling the bin from the shared heap with one lock round-trip
+    when it is empty.
+*/
+static void *tcache_get(int idx, size_t asize)
+{
+    void *bp = tcache.head[idx];
+    int fill, i;
+
+    if (bp != NULL) {
+        tcache.head[idx] = TCACHE_NEXT(bp);
+        tcache.count[idx]--;
+        return bp;
+    }
+
+    fill = MAX(1, MIN(TCACHE_FILL_MAX, TCACHE_FILL_BYTES / asize));
+    TCACHE_LOCK(idx);
+    bp = tcache_alloc_central(idx, asize);
+    for (i = 1; bp != NULL && i < fill; i++) {
+        void *extra = tcache_alloc_central(idx, asize);
+        if (extra == NULL)
+            break;
+        TCACHE_NEXT(extra) = tcache.head[idx];
+        tcache.head[idx] = extra;
+        tcache.count[idx]++;
+    }
+    UNLOCK();
+    if (!tcache.registered) {
+        tcache.registered = 1;
+        pthread_setspecific(tcache_key, &tcache);
+    }
+    return bp;
+}
+
+/*
+    tcache_put - cache a block in bin idx; an overfull bin gives half of
+    its blocks back to the shared heap.
+*/
+static void tcache_put(int idx, void *bp)
+{
+    TCACHE_NEXT(bp) = tcache.head[idx];
+    tcache.head[idx] = bp;
+    if (++tcache.count[idx] > TCACHE_MAX_COUNT)
+        tcache_flush(idx, TCACHE_MAX_COUNT / 2);
+}
+
+/*
+    tcache_flush - return all but keep blocks of bin idx to the shared heap.
+*/
+static void tcache_flush(int idx, int keep)
+{
+    void *bp;
+
+    TCACHE_LOCK(idx);
+    while (tcache.count[idx] > keep) {
+        bp = tcache.head[idx];
+        tcache.head[idx] = TCACHE_NEXT(bp);
+        tcache.count[idx]--;
+        tcache_free_central(idx, bp);
+    }
+    UNLOCK();
+}
+
+/*
+    tcache_destroy - thread exit destructor, gives every cached block back.
+*/
+static void tcache_destroy(void *arg)
+{
+    int idx;
+
+    for (idx = 0; idx < TCACHE_BINS; idx++)
+        if (tcache.count[idx])
+            tcache_flush(idx, 0);
+    tcache.registered = 0;
+#if HEAPS
+    /* leave the heap first: a remote_free that comes after the drain sees no thread */
+    if (my_heap != NULL) {
+        __atomic_fetch_sub(&my_heap->threads, 1, __ATOMIC_SEQ_CST);
+        heap_enter(my_heap);
+        heap_leave();
+        my_heap = NULL;
+    }
+#endif
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+#if HEAPS
+/*
+    thread_heap - the heap of the calling thread, handed out round-robin.
+    The thread exit destructor gives it back.
+*/
+static struct mm_heap *thread_heap(void)
+{
+    if (my_heap == NULL) {
+        my_heap = &heaps[__atomic_fetch_add(&next_heap, 1, __ATOMIC_RELAXED) % HEAPS];
+        __atomic_fetch_add(&my_heap->threads, 1, __ATOMIC_SEQ_CST);
+        if (!tcache.registered) {
+            tcache.registered = 1;
+            pthread_setspecific(tcache_key, &tcache);
+        }
+    }
+    return my_heap;
+}
+
+/*
+    heap_of - the heap whose arenas hold bp. Callers have sorted out slab
+    and mapped blocks, so anything else is not a block of ours.
+*/
+static struct mm_heap *heap_of(void *bp)
+{
+    int chain = mem_chain_of(bp);
+
+    if (chain < 0) {
+        fprintf(stderr, "mm: %p is not in any heap\n", bp);
+        abort();
+    }
+    return &heaps[chain];
+}
+
+/*
+    heap_enter - lock h and make it the heap the internal functions and
+    memlib work on. Blocks other threads freed meanwhile go back first.
+*/
+static void heap_enter(struct mm_heap *h)
+{
+    void *bp, *next;
+
+    pthread_mutex_lock(&h->lock);
+    cur_heap = h;
+    mem_select(h->id);
+    if (__atomic_load_n(&h->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    bp = __atomic_exchange_n(&h->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next) {
+        next = REMOTE_NEXT(bp);
+        free_block(bp);
     }
 }
 
+static void heap_leave(void)
+{
+    pthread_mutex_unlock(&cur_heap->lock);
+}
+
+/*
+    remote_free - push bp on the remote stack of its heap h. Only pushes
+    race with each other, the owner takes the whole stack at once, so a
+    plain compare-and-swap loop is enough (no ABA). If no thread uses h
+    any more the caller drains the stack itself.
+*/
+static void remote_free(struct mm_heap *h, void *bp)
+{
+    void *head = __atomic_load_n(&h->remote, __ATOMIC_RELAXED);
+
+    do {
+        REMOTE_NEXT(bp) = head;
+    } while (!__atomic_compare_exchange_n(&h->remote, &head, bp, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    if (__atomic_load_n(&h->threads, __ATOMIC_SEQ_CST) == 0) {
+        heap_enter(h);
+        heap_leave();
+    }
+}
+#endif
+#endif
 
 /*
     mm_check - print the information of the free block beginning with **bp**.
@@ -543,7 +2768,7 @@ void mm_check(const char *function, char* bp)
 {
     #ifdef DEBUG
     printf("\n---cur func: %s :\n", function);
-    printf("addr_start: 0x%lx, addr_end: 0x%lx, size_head: %lu, size_foot: %lu, PRED=0x%lx, SUCC=0x%lx \n", (size_t)bp - WSIZE,
+    printf("addr_start: 0x%lx, addr_end: 0x%lx, size_head: %lu, size_foot: %lu, PRED=0x%lx, SUCC=0x%lx \n", (size_t)HDRP(bp),
         (size_t)FTRP(bp), GET_SIZE(HDRP(bp)), GET_SIZE(FTRP(bp)), GET_PRED(bp), GET_SUCC(bp));
     #endif
 }
@@ -4,13 +4,102 @@
 extern "C" {
 #endif
 
+/* this allocator; malloclab-simple/mm.h has only the basic calls */
+#define MM_MALLOCLAB 1
+
+/*
+ * mm_stats - allocator statistics. The event counters are only kept when
+ * built with MM_STATS=1 (zero otherwise); the free block figures come from
+ * a walk over the heap made by mm_stats() itself.
+ */
+#define MM_STATS_BINS 32
+struct mm_stats {
+    size_t mallocs;
+    size_t frees;
+    size_t reallocs;
+    size_t zero_hits;       /* mm_calloc calls on memory known to be zero */
+    size_t fit_steps;       /* free blocks looked at while searching a fit */
+    size_t fit_cutoffs;     /* list searches ended before the end of the list */
+    size_t splits;          /* free blocks split by place or realloc */
+    size_t coalesces;       /* free blocks merged with a neighbour */
+    size_t extends;         /* extend_heap calls */
+    size_t consolidations;  /* quick list flushes (DEFER=1) */
+
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest_free;
+    size_t free_hist[MM_STATS_BINS];    /* free blocks with 2^i <= size < 2^(i+1) */
+    double ext_frag;        /* 1 - largest_free / free_bytes */
+};
+
 extern double get_utilization();
+extern void mm_stats(struct mm_stats *st);
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+/*
+ * Batches: mm_malloc_batch fills ptrs[0..n) with blocks of size bytes
+ * (mm_malloc_batch_sizes: of sizes[i] bytes) and returns how many it got,
+ * leaving NULL where it failed; mm_free_batch frees ptrs[0..n), skipping
+ * NULL. Cheaper than n single calls: one lock, and one fit search and
+ * split per free block used, not per block.
+ */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern size_t mm_malloc_batch_sizes(const size_t *sizes, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
 extern void mm_free (void *ptr);
+/*
+ * mm_free_sized - mm_free for a block whose size (as last passed to
+ * mm_malloc, mm_realloc, ...) the caller knows, like C++14 sized delete.
+ * With THREAD_SAFE=1 small blocks skip reading the block head, otherwise
+ * it is mm_free; HEAP_CHECK=1 checks the size.
+ */
+extern void mm_free_sized(void *ptr, size_t size);
 extern void *mm_realloc(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void mm_set_mmap_threshold(size_t threshold);
+/*
+ * Fit policies for mm_set_policy: which free block of a list mm_malloc
+ * takes. Blocks in the TREE_FIT tree are always taken best fit. The
+ * default is MM_FIT_FIRST when built with FIRST_FIT=1, else MM_FIT_BEST.
+ */
+#define MM_FIT_FIRST 0  /* first fit, in LIFO list order */
+#define MM_FIT_BEST 1   /* the smallest block that fits */
+#define MM_FIT_ADDR 2   /* address-ordered first fit: the lowest block that fits */
+#define MM_FIT_NEXT 3   /* next fit: first fit from where the last search stopped */
+#define MM_FIT_GOOD 4   /* good fit: best of the first depth fitting blocks */
+#define MM_FIT_POLICIES 5
+extern int mm_set_policy(int policy);
+/*
+ * mm_set_good_fit - bound the good fit search: the best of the first depth
+ * fitting blocks (8 by default, <= 0 for no limit), but stop at once on a
+ * block at most slack bytes bigger than needed (0 by default: exact fit).
+ */
+extern void mm_set_good_fit(int depth, size_t slack);
+/*
+ * mm_checkheap - check the heap and print the first problem on stderr;
+ * returns 0 if it is consistent, -1 otherwise. level 1 walks the blocks,
+ * level 2 also the free lists, level 3 also reads the free blocks marked
+ * zero (for mm_calloc) to see that they are. mm_set_check makes mm_malloc/mm_free/
+ * mm_realloc run it every every-th call (built with HEAP_CHECK=1).
+ */
+extern int mm_checkheap(int level);
+extern void mm_set_check(int level, unsigned long every);
+/*
+ * Heap profile (built with PROFILE=1): about one allocation per rate bytes
+ * (512 KB unless set) is sampled with its backtrace. mm_profile_dump writes
+ * the live bytes per allocation site; MM_PROFILE=path in the environment
+ * dumps at exit, MM_PROFILE_FORMAT=pprof picks the pprof format there.
+ */
+#define MM_PROFILE_FOLDED 0     /* one "outer;...;inner bytes" line per site */
+#define MM_PROFILE_PPROF 1      /* gperftools heap profile for pprof */
+extern void mm_set_profile_rate(size_t rate);
+extern int mm_profile_dump(const char *path, int format);
 extern size_t user_malloc_size ;
 extern size_t heap_size ;
+extern size_t trimmed_size ;
+extern size_t released_size ;
 
 #ifdef __cplusplus
 }
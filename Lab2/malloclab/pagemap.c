@@ -0,0 +1,63 @@
+/*
+ * pagemap.c - a byte per page, kept in a two-level radix tree.
+ *
+ * A 48-bit address has 36 bits of page number. The top PAGEMAP_ROOT_BITS
+ * select a leaf in pagemap_root, the rest index the leaf. The root lives in
+ * .bss (untouched entries cost nothing), leaves are mmap-ed on first use and
+ * never freed, so lookups need no lock.
+ */
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "pagemap.h"
+
+#define PAGEMAP_BITS (48 - PAGEMAP_SHIFT)
+#define PAGEMAP_LEAF_BITS 18
+#define PAGEMAP_ROOT_BITS (PAGEMAP_BITS - PAGEMAP_LEAF_BITS)
+#define PAGEMAP_LEAF_SIZE (1UL << PAGEMAP_LEAF_BITS)
+
+static unsigned char *pagemap_root[1UL << PAGEMAP_ROOT_BITS];
+
+/*
+ * pagemap_set - set the byte of every page that overlaps [addr, addr + len).
+ *     Returns -1 if a leaf could not be mapped. Writers of different pages
+ *     may race (each heap maps arenas under its own lock): a new leaf goes
+ *     in with a compare-and-swap and the loser unmaps its own.
+ */
+int pagemap_set(const void *addr, size_t len, unsigned char val)
+{
+    uintptr_t pn = (uintptr_t)addr >> PAGEMAP_SHIFT;
+    uintptr_t end = ((uintptr_t)addr + len + PAGEMAP_PAGE - 1) >> PAGEMAP_SHIFT;
+    unsigned char *leaf, *fresh;
+
+    for (; pn < end; pn++) {
+        leaf = __atomic_load_n(&pagemap_root[pn >> PAGEMAP_LEAF_BITS], __ATOMIC_ACQUIRE);
+        if (leaf == NULL) {
+            fresh = mmap(NULL, PAGEMAP_LEAF_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (fresh == MAP_FAILED)
+                return -1;
+            if (__atomic_compare_exchange_n(&pagemap_root[pn >> PAGEMAP_LEAF_BITS], &leaf, fresh, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                leaf = fresh;
+            else
+                munmap(fresh, PAGEMAP_LEAF_SIZE);   /* leaf is the winner's */
+        }
+        leaf[pn & (PAGEMAP_LEAF_SIZE - 1)] = val;
+    }
+    return 0;
+}
+
+/*
+ * pagemap_get - the byte of the page that holds addr, PAGEMAP_NONE if unset.
+ */
+unsigned char pagemap_get(const void *addr)
+{
+    uintptr_t pn = (uintptr_t)addr >> PAGEMAP_SHIFT;
+    unsigned char *leaf;
+
+    if ((pn >> PAGEMAP_BITS) != 0)
+        return PAGEMAP_NONE;
+    leaf = __atomic_load_n(&pagemap_root[pn >> PAGEMAP_LEAF_BITS], __ATOMIC_ACQUIRE);
+    return leaf ? leaf[pn & (PAGEMAP_LEAF_SIZE - 1)] : PAGEMAP_NONE;
+}
@@ -0,0 +1,24 @@
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * pagemap - one byte of information per 4 KB page of the address space,
+ * stored in a two-level radix tree so that any address can be looked up.
+ */
+#define PAGEMAP_SHIFT 12
+#define PAGEMAP_PAGE (1UL << PAGEMAP_SHIFT)
+
+/* Values stored in the map */
+#define PAGEMAP_NONE 0   /* not ours, e.g. a direct mmap block */
+#define PAGEMAP_SLAB 1   /* slab page, see slab.c */
+#define PAGEMAP_ARENA(chain) (2 + (chain))  /* memlib arena of that chain */
+
+int pagemap_set(const void *addr, size_t len, unsigned char val);
+unsigned char pagemap_get(const void *addr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,372 @@
+/*
+ * preload.c - the C allocation API on top of mm.c, for LD_PRELOAD.
+ *
+ * `make preload` links this with the allocator into libmalloc.so, built
+ * THREAD_SAFE=1 and ALIGN16=1 since a drop-in malloc must serve threads and
+ * return 16-byte aligned memory, as glibc does. The other make flags pick
+ * the variant as usual:
+ *
+ *     make preload SEG_LIST=1 SLAB=1
+ *     LD_PRELOAD=./libmalloc.so ls -l
+ *
+ * The C++ operator new and delete family is replaced as a whole, so that
+ * sized delete can use mm_free_sized, see _ZdlPvm.
+ *
+ * The heap is set up by the first call (mm_init is never called by the
+ * program). Allocations made while mm_init itself runs, e.g. by the
+ * unwinder the profiler loads, are served from a small static buffer.
+ */
+#define _GNU_SOURCE     /* RTLD_NEXT */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+
+#include "mm.h"
+
+#if !THREAD_SAFE || !ALIGN16
+#error "preload.c needs THREAD_SAFE=1 and ALIGN16=1"
+#endif
+
+#define PRELOAD_ALIGN 16
+#define BOOT_SIZE (64 * 1024)
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int ready;
+static __thread int initializing __attribute__((tls_model("initial-exec")));
+
+/* bump allocator for calls from inside mm_init, never freed */
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(PRELOAD_ALIGN)));
+static size_t boot_used;
+
+#define BOOT_OWNS(p) ((char *)(p) >= boot_buf && (char *)(p) < boot_buf + BOOT_SIZE)
+#define BOOT_SIZE_OF(p) (*(size_t *)((char *)(p) - PRELOAD_ALIGN))
+
+static void preload_init(void)
+{
+    initializing = 1;
+    if (mm_init() < 0)
+        abort();
+    initializing = 0;
+    __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * ensure_init - set up the heap on the first call. Returns 0 if mm_* may
+ *     be used, -1 if this thread is inside mm_init.
+ */
+static inline int ensure_init(void)
+{
+    if (__atomic_load_n(&ready, __ATOMIC_ACQUIRE))
+        return 0;
+    if (initializing)
+        return -1;
+    pthread_once(&init_once, preload_init);
+    return 0;
+}
+
+/*
+ * boot_alloc - size bytes from boot_buf, with the size in front so that
+ *     realloc and malloc_usable_size work on them
+ */
+static void *boot_alloc(size_t size)
+{
+    size_t need = PRELOAD_ALIGN + ((size + PRELOAD_ALIGN - 1) & ~(size_t)(PRELOAD_ALIGN - 1));
+    size_t old = __atomic_fetch_add(&boot_used, need, __ATOMIC_RELAXED);
+    char *p;
+
+    if (size > BOOT_SIZE || old + need > BOOT_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    p = boot_buf + old + PRELOAD_ALIGN;
+    BOOT_SIZE_OF(p) = size;
+    return p;
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (ensure_init() < 0)
+        return boot_alloc(size);
+    if ((p = mm_malloc(size ? size : 1)) == NULL)     /* malloc(0) is a unique pointer */
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *p)
+{
+    if (p == NULL || BOOT_OWNS(p))
+        return;
+    mm_free(p);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    size_t bytes;
+    void *p;
+
+    if (__builtin_mul_overflow(n, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (ensure_init() < 0)
+        return boot_alloc(bytes);   /* boot_buf is still zero */
+    if ((p = mm_calloc(bytes ? bytes : 1, 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *realloc(void *p, size_t size)
+{
+    void *newp;
+
+    if (p == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(p);
+        return NULL;
+    }
+    if (BOOT_OWNS(p)) {
+        if ((newp = malloc(size)) != NULL)
+            memcpy(newp, p, BOOT_SIZE_OF(p) < size ? BOOT_SIZE_OF(p) : size);
+        return newp;
+    }
+    if ((newp = mm_realloc(p, size)) == NULL)
+        errno = ENOMEM;
+    return newp;
+}
+
+/*
+ * aligned - size bytes aligned to align, a power of 2
+ */
+static void *aligned(size_t align, size_t size)
+{
+    void *p;
+
+    if (align <= PRELOAD_ALIGN)
+        return malloc(size);
+    if (ensure_init() < 0) {
+        errno = ENOMEM;     /* nothing inside mm_init needs this */
+        return NULL;
+    }
+    if ((p = mm_memalign(align, size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+        return EINVAL;
+    if ((p = aligned(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned(align, size);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    return aligned_alloc(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return aligned(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *p)
+{
+    if (p == NULL)
+        return 0;
+    if (BOOT_OWNS(p))
+        return BOOT_SIZE_OF(p);
+    return mm_usable_size(p);
+}
+
+/*
+ * C++ operator new and delete: plain, array, nothrow, sized and aligned,
+ * under their Itanium C++ ABI names so that this file stays C. All of them
+ * are here, so a block from any operator new goes back to this allocator,
+ * whichever operator delete the compiler picked. Code built with
+ * -fsized-deallocation (the default from C++14 on) passes the size it
+ * asked operator new for to sized delete, which is what new asked
+ * malloc for.
+ *
+ * A failing operator new calls the next definition (libstdc++'s) instead:
+ * it runs the new_handler and throws std::bad_alloc, which C cannot, and
+ * allocates through malloc here all the same.
+ */
+static void *next_new(const char *name)
+{
+    void *fn = dlsym(RTLD_NEXT, name);
+
+    if (fn == NULL)     /* no C++ runtime behind us */
+        abort();
+    return fn;
+}
+
+void *_Znwm(size_t size)
+{
+    void *p = malloc(size);
+
+    return p != NULL ? p : ((void *(*)(size_t))next_new("_Znwm"))(size);
+}
+
+void *_Znam(size_t size)
+{
+    void *p = malloc(size);
+
+    return p != NULL ? p : ((void *(*)(size_t))next_new("_Znam"))(size);
+}
+
+void *_ZnwmRKSt9nothrow_t(size_t size, const void *nt)
+{
+    void *p = malloc(size);
+
+    return p != NULL ? p : ((void *(*)(size_t, const void *))next_new("_ZnwmRKSt9nothrow_t"))(size, nt);
+}
+
+void *_ZnamRKSt9nothrow_t(size_t size, const void *nt)
+{
+    void *p = malloc(size);
+
+    return p != NULL ? p : ((void *(*)(size_t, const void *))next_new("_ZnamRKSt9nothrow_t"))(size, nt);
+}
+
+void *_ZnwmSt11align_val_t(size_t size, size_t align)
+{
+    void *p = aligned(align, size);
+
+    return p != NULL ? p : ((void *(*)(size_t, size_t))next_new("_ZnwmSt11align_val_t"))(size, align);
+}
+
+void *_ZnamSt11align_val_t(size_t size, size_t align)
+{
+    void *p = aligned(align, size);
+
+    return p != NULL ? p : ((void *(*)(size_t, size_t))next_new("_ZnamSt11align_val_t"))(size, align);
+}
+
+void *_ZnwmSt11align_val_tRKSt9nothrow_t(size_t size, size_t align, const void *nt)
+{
+    void *p = aligned(align, size);
+
+    return p != NULL ? p : ((void *(*)(size_t, size_t, const void *))
+                            next_new("_ZnwmSt11align_val_tRKSt9nothrow_t"))(size, align, nt);
+}
+
+void *_ZnamSt11align_val_tRKSt9nothrow_t(size_t size, size_t align, const void *nt)
+{
+    void *p = aligned(align, size);
+
+    return p != NULL ? p : ((void *(*)(size_t, size_t, const void *))
+                            next_new("_ZnamSt11align_val_tRKSt9nothrow_t"))(size, align, nt);
+}
+
+void _ZdlPv(void *p)
+{
+    free(p);
+}
+
+void _ZdaPv(void *p)
+{
+    free(p);
+}
+
+/* this file's own unsized deletes, bound here even if the program has its own */
+static void own_delete(void *p) __attribute__((alias("_ZdlPv")));
+static void own_delete_array(void *p) __attribute__((alias("_ZdaPv")));
+
+/*
+ * sized_delete - the sized delete of p, allocated with size bytes. A
+ *     program that replaces plain delete but not sized delete expects the
+ *     latter to call the former, as libstdc++'s does, so then it does.
+ */
+static void sized_delete(void *p, size_t size, void (*plain)(void *), void (*own)(void *))
+{
+    if (plain != own) {
+        plain(p);
+        return;
+    }
+    if (p == NULL || BOOT_OWNS(p))
+        return;
+    mm_free_sized(p, size ? size : 1);     /* as malloc(0) asked for 1 */
+}
+
+void _ZdlPvm(void *p, size_t size)
+{
+    sized_delete(p, size, _ZdlPv, own_delete);
+}
+
+void _ZdaPvm(void *p, size_t size)
+{
+    sized_delete(p, size, _ZdaPv, own_delete_array);
+}
+
+void _ZdlPvRKSt9nothrow_t(void *p, const void *nt)
+{
+    _ZdlPv(p);
+}
+
+void _ZdaPvRKSt9nothrow_t(void *p, const void *nt)
+{
+    _ZdaPv(p);
+}
+
+void _ZdlPvSt11align_val_t(void *p, size_t align)
+{
+    free(p);
+}
+
+void _ZdaPvSt11align_val_t(void *p, size_t align)
+{
+    free(p);
+}
+
+/* aligned blocks are cut to fit by mm_memalign, the size says nothing more */
+void _ZdlPvmSt11align_val_t(void *p, size_t size, size_t align)
+{
+    _ZdlPvSt11align_val_t(p, align);
+}
+
+void _ZdaPvmSt11align_val_t(void *p, size_t size, size_t align)
+{
+    _ZdaPvSt11align_val_t(p, align);
+}
+
+void _ZdlPvSt11align_val_tRKSt9nothrow_t(void *p, size_t align, const void *nt)
+{
+    _ZdlPvSt11align_val_t(p, align);
+}
+
+void _ZdaPvSt11align_val_tRKSt9nothrow_t(void *p, size_t align, const void *nt)
+{
+    _ZdaPvSt11align_val_t(p, align);
+}
@@ -0,0 +1,404 @@
+/*
+ * profile.c - sampling heap profiler layered over mm.c.
+ *
+ * mm_malloc calls prof_malloc with every block it hands out. Each thread
+ * counts down prof_left, and the allocation that takes it below zero is
+ * sampled; the next gap is drawn from an exponential distribution with mean
+ * prof_rate, so every byte has the same chance of being sampled whatever
+ * the size of the blocks around it. A sample of size bytes stands for
+ * 1 / (1 - exp(-size / rate)) such allocations, which makes the totals an
+ * unbiased estimate of the real ones.
+ *
+ *   stacks: one entry per distinct backtrace, with the allocated and the
+ *           still live counts and bytes charged to it
+ *   slots:  sampled blocks not freed yet, open addressing keyed by address,
+ *           so mm_free can uncharge them from their stack
+ *
+ * Both tables are static (no allocation from inside the allocator) and
+ * guarded by prof_lock. mm_free asks prof_free about every block; while
+ * nothing sampled hashes to its slot, that is one load and no lock.
+ */
+#define _GNU_SOURCE     /* dladdr */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+
+#include "profile.h"
+
+#define PROF_STACKS 4096            /* distinct backtraces, a power of 2 */
+#define PROF_SLOT_BITS 15
+#define PROF_SLOTS (1UL << PROF_SLOT_BITS)  /* sampled live blocks */
+#define PROF_SKIP_MAX 8             /* allocator frames above prof_sample */
+#define PROF_SKIP 2                 /* prof_sample and mm_*, if linked into the program */
+#define PROF_IDLE_GAP (16L << 20)   /* recheck the rate this often when off */
+
+#define SLOT_OF(p) ((((uintptr_t)(p) >> 4) * 0x9E3779B97F4A7C15UL) >> (64 - PROF_SLOT_BITS))
+#define SLOT_NEXT(i) (((i) + 1) & (PROF_SLOTS - 1))
+
+struct prof_stack {
+    uint64_t hash;                  /* 0 while unused */
+    int depth;
+    void *pc[PROF_DEPTH];           /* innermost frame first */
+    double alloc_count, alloc_bytes;
+    double live_count, live_bytes;
+};
+
+struct prof_slot {
+    void *p;                        /* NULL while empty */
+    struct prof_stack *stack;
+    double count, bytes;            /* what this sample stands for */
+};
+
+/* buffered output without stdio, which may allocate */
+struct prof_out {
+    int fd;
+    int err;
+    size_t len;
+    char buf[4096];
+};
+
+static struct prof_stack stacks[PROF_STACKS];
+static struct prof_slot slots[PROF_SLOTS];
+static size_t nslots;
+static size_t prof_rate = PROF_RATE;
+static void *prof_base;             /* load address of the allocator */
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__thread long prof_left __attribute__((tls_model("initial-exec")));
+static __thread int prof_busy __attribute__((tls_model("initial-exec")));
+static __thread uint64_t prof_seed __attribute__((tls_model("initial-exec")));
+
+/*
+ * prof_set_rate - sample one allocation per rate bytes on average, 0 to
+ *     stop sampling. Blocks sampled before stay in the profile until freed.
+ */
+void prof_set_rate(size_t rate)
+{
+    void *pc[1];
+    Dl_info info;
+
+    backtrace(pc, 1);   /* the first call loads the unwinder, which allocates */
+    if (dladdr((void *)prof_sample, &info))
+        prof_base = info.dli_fbase;
+    __atomic_store_n(&prof_rate, rate, __ATOMIC_RELAXED);
+}
+
+/*
+ * next_gap - bytes until the next sample: exponential with mean rate
+ */
+static long next_gap(size_t rate)
+{
+    uint64_t x = prof_seed;
+    double u;
+
+    if (x == 0)
+        x = (uintptr_t)&prof_seed ^ 0x9E3779B97F4A7C15UL;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    prof_seed = x;
+    u = ((x >> 11) + 1) * 0x1p-53;  /* (0, 1] */
+    return (long)(-log(u) * rate) + 1;
+}
+
+/*
+ * stack_find - the entry of the backtrace pc[0 .. depth), made on first use.
+ *     NULL once the table is full.
+ */
+static struct prof_stack *stack_find(void **pc, int depth)
+{
+    uint64_t h = 14695981039346656037UL;
+    struct prof_stack *s;
+    int i;
+
+    for (i = 0; i < depth; i++)
+        h = (h ^ (uintptr_t)pc[i]) * 1099511628211UL;
+    h |= 1;
+    for (i = 0; i < PROF_STACKS; i++) {
+        s = &stacks[(h + i) & (PROF_STACKS - 1)];
+        if (s->hash == 0) {
+            s->hash = h;
+            s->depth = depth;
+            memcpy(s->pc, pc, depth * sizeof(void *));
+            return s;
+        }
+        if (s->hash == h && s->depth == depth && !memcmp(s->pc, pc, depth * sizeof(void *)))
+            return s;
+    }
+    return NULL;
+}
+
+/*
+ * slot_find - the slot of sampled block p, NULL if p was not sampled
+ */
+static struct prof_slot *slot_find(void *p)
+{
+    size_t i;
+
+    for (i = SLOT_OF(p); slots[i].p != NULL; i = SLOT_NEXT(i))
+        if (slots[i].p == p)
+            return &slots[i];
+    return NULL;
+}
+
+/*
+ * slot_insert - remember p as a sample of stack. Keeps one slot empty so
+ *     that every probe ends; returns -1 when that one is all that is left.
+ */
+static int slot_insert(void *p, struct prof_stack *stack, double count, double bytes)
+{
+    size_t i;
+
+    if (nslots >= PROF_SLOTS - 1)
+        return -1;
+    for (i = SLOT_OF(p); slots[i].p != NULL; i = SLOT_NEXT(i))
+        ;
+    slots[i].stack = stack;
+    slots[i].count = count;
+    slots[i].bytes = bytes;
+    __atomic_store_n(&slots[i].p, p, __ATOMIC_RELEASE);
+    nslots++;
+    stack->live_count += count;
+    stack->live_bytes += bytes;
+    return 0;
+}
+
+/*
+ * slot_delete - uncharge s from its stack and empty it. Later entries of
+ *     the run move back into the hole (no tombstones), and a slot is only
+ *     emptied once nothing behind it belongs there, so the lock-free check
+ *     in prof_free never sees the home slot of a sampled block empty.
+ */
+static void slot_delete(struct prof_slot *s)
+{
+    size_t hole = s - slots, i = hole;
+
+    s->stack->live_count -= s->count;
+    s->stack->live_bytes -= s->bytes;
+    if (s->stack->live_count < 0.5)    /* each sample counts >= 1: none left */
+        s->stack->live_count = s->stack->live_bytes = 0;
+    while (slots[i = SLOT_NEXT(i)].p != NULL) {
+        /* slots[i] may fill the hole unless its home lies in (hole, i] */
+        if (((i - SLOT_OF(slots[i].p)) & (PROF_SLOTS - 1)) >= ((i - hole) & (PROF_SLOTS - 1))) {
+            slots[hole].stack = slots[i].stack;
+            slots[hole].count = slots[i].count;
+            slots[hole].bytes = slots[i].bytes;
+            __atomic_store_n(&slots[hole].p, slots[i].p, __ATOMIC_RELEASE);
+            hole = i;
+        }
+    }
+    __atomic_store_n(&slots[hole].p, NULL, __ATOMIC_RELEASE);
+    nslots--;
+}
+
+/*
+ * lib_frames - the number of frames at the top of pc[0 .. depth) that are
+ *     the allocator's own: prof_sample, the mm_* entry point and whatever
+ *     wrapped it (mm_calloc, the batch calls, malloc in preload.c, ...).
+ *     Built into the program there is no telling, so PROF_SKIP then.
+ */
+static int lib_frames(void **pc, int depth)
+{
+    Dl_info info;
+    int i;
+
+    for (i = 1; i < depth; i++)
+        if (!dladdr(pc[i], &info) || info.dli_fbase != prof_base)
+            return i;
+    return depth < PROF_SKIP ? depth : PROF_SKIP;
+}
+
+/*
+ * prof_sample - record the backtrace of block p of size bytes and draw the
+ *     gap to this thread's next sample
+ */
+void prof_sample(void *p, size_t size)
+{
+    size_t rate = __atomic_load_n(&prof_rate, __ATOMIC_RELAXED);
+    void *pc[PROF_DEPTH + PROF_SKIP_MAX];
+    struct prof_stack *s;
+    double count;
+    int depth, skip;
+
+    if (rate == 0) {
+        prof_left = PROF_IDLE_GAP;
+        return;
+    }
+    prof_left = next_gap(rate);
+    if (prof_busy)      /* allocating from inside the profiler */
+        return;
+    prof_busy = 1;
+    depth = backtrace(pc, PROF_DEPTH + PROF_SKIP_MAX);
+    skip = lib_frames(pc, depth);
+    depth -= skip;
+    if (depth > PROF_DEPTH)
+        depth = PROF_DEPTH;
+    count = 1.0 / -expm1(-(double)size / rate);
+
+    pthread_mutex_lock(&prof_lock);
+    if ((s = stack_find(pc + skip, depth)) != NULL &&
+        slot_insert(p, s, count, count * size) == 0) {
+        s->alloc_count += count;
+        s->alloc_bytes += count * size;
+    }
+    pthread_mutex_unlock(&prof_lock);
+    prof_busy = 0;
+}
+
+/*
+ * prof_free - forget p if it was sampled
+ */
+void prof_free(void *p)
+{
+    struct prof_slot *s;
+
+    if (__atomic_load_n(&slots[SLOT_OF(p)].p, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    pthread_mutex_lock(&prof_lock);
+    if ((s = slot_find(p)) != NULL)
+        slot_delete(s);
+    pthread_mutex_unlock(&prof_lock);
+}
+
+/*
+ * prof_realloc - oldp was resized to size bytes at newp without going
+ *     through mm_malloc; if it was sampled, keep charging its stack
+ */
+void prof_realloc(void *oldp, void *newp, size_t size)
+{
+    size_t rate = __atomic_load_n(&prof_rate, __ATOMIC_RELAXED);
+    struct prof_slot *s;
+    struct prof_stack *stack;
+    double count;
+
+    if (__atomic_load_n(&slots[SLOT_OF(oldp)].p, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    pthread_mutex_lock(&prof_lock);
+    if ((s = slot_find(oldp)) != NULL) {
+        stack = s->stack;
+        slot_delete(s);
+        if (rate != 0) {
+            count = 1.0 / -expm1(-(double)size / rate);
+            slot_insert(newp, stack, count, count * size);
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+}
+
+static void out_flush(struct prof_out *out)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < out->len) {
+        if ((n = write(out->fd, out->buf + done, out->len - done)) <= 0) {
+            out->err = 1;
+            break;
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+static void out_printf(struct prof_out *out, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room;
+    int n;
+
+    if (sizeof(out->buf) - out->len < 512)
+        out_flush(out);
+    room = sizeof(out->buf) - out->len;
+    va_start(ap, fmt);
+    n = vsnprintf(out->buf + out->len, room, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        out->len += (size_t)n < room ? (size_t)n : room - 1;   /* truncated */
+}
+
+/*
+ * out_frame - a name for the frame at pc: its symbol, or object+offset
+ */
+static void out_frame(struct prof_out *out, void *pc)
+{
+    Dl_info info = {0};
+    const char *base;
+
+    if (dladdr(pc, &info) && info.dli_sname != NULL) {
+        out_printf(out, "%s", info.dli_sname);
+    } else if (info.dli_fname != NULL && info.dli_fname[0] != '\0') {
+        base = strrchr(info.dli_fname, '/');
+        out_printf(out, "%s+0x%lx", base ? base + 1 : info.dli_fname,
+                   (unsigned long)((char *)pc - (char *)info.dli_fbase));
+    } else {
+        out_printf(out, "0x%lx", (unsigned long)pc);
+    }
+}
+
+/*
+ * prof_dump - write the live heap to fd: PROF_FOLDED prints one line per
+ *     allocation site, outermost frame first, with its live bytes;
+ *     PROF_PPROF writes a heap profile pprof reads, with the mappings it
+ *     needs to symbolize. Returns 0, or -1 if a write failed.
+ */
+int prof_dump(int fd, int format)
+{
+    struct prof_out out = {.fd = fd};
+    struct prof_stack *s;
+    double lc = 0, lb = 0, ac = 0, ab = 0;
+    char maps[4096];
+    ssize_t n;
+    int i, j, mfd;
+
+    prof_busy = 1;
+    pthread_mutex_lock(&prof_lock);
+    if (format == PROF_PPROF) {
+        for (i = 0; i < PROF_STACKS; i++) {
+            lc += stacks[i].live_count;
+            lb += stacks[i].live_bytes;
+            ac += stacks[i].alloc_count;
+            ab += stacks[i].alloc_bytes;
+        }
+        out_printf(&out, "heap profile: %.0f: %.0f [%.0f: %.0f] @ heapprofile\n", lc, lb, ac, ab);
+    }
+    for (i = 0; i < PROF_STACKS; i++) {
+        s = &stacks[i];
+        if (s->hash == 0)
+            continue;
+        if (format == PROF_PPROF) {
+            out_printf(&out, "%.0f: %.0f [%.0f: %.0f] @", s->live_count, s->live_bytes,
+                       s->alloc_count, s->alloc_bytes);
+            for (j = 0; j < s->depth; j++)
+                out_printf(&out, " %p", s->pc[j]);
+            out_printf(&out, "\n");
+        } else if (s->live_bytes >= 0.5) {
+            for (j = s->depth - 1; j >= 0; j--) {
+                out_frame(&out, s->pc[j]);
+                out_printf(&out, j ? ";" : "");
+            }
+            out_printf(&out, " %.0f\n", s->live_bytes);
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    if (format == PROF_PPROF) {
+        out_printf(&out, "\nMAPPED_LIBRARIES:\n");
+        out_flush(&out);
+        if ((mfd = open("/proc/self/maps", O_RDONLY)) >= 0) {
+            while ((n = read(mfd, maps, sizeof(maps))) > 0)
+                if (write(fd, maps, n) != n)
+                    out.err = 1;
+            close(mfd);
+        }
+    }
+    out_flush(&out);
+    prof_busy = 0;
+    return out.err ? -1 : 0;
+}
@@ -0,0 +1,42 @@
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * profile - sampling heap profiler. On average one allocation per
+ * prof_rate bytes is sampled: its backtrace is recorded and the block is
+ * remembered until freed, so the profile shows the live bytes of every
+ * allocation site, scaled up to estimate the unsampled ones as well.
+ */
+#define PROF_RATE (512 * 1024)  /* default mean bytes between samples */
+#define PROF_DEPTH 32           /* frames kept per backtrace */
+
+/* Dump formats */
+#define PROF_FOLDED 0   /* "main;f;g <bytes>" lines, for flamegraph.pl */
+#define PROF_PPROF 1    /* gperftools text heap profile, for pprof */
+
+extern __thread long prof_left;     /* bytes until this thread's next sample */
+
+void prof_set_rate(size_t rate);
+void prof_sample(void *p, size_t size);
+void prof_free(void *p);
+void prof_realloc(void *oldp, void *newp, size_t size);
+int prof_dump(int fd, int format);
+
+/*
+ * prof_malloc - count size bytes allocated at p and sample p once this
+ *     thread has allocated prof_left more bytes. Returns p. Always inlined,
+ *     so that it adds no frame of its own to the backtrace.
+ */
+static inline __attribute__((always_inline)) void *prof_malloc(void *p, size_t size)
+{
+    if (p != NULL && (prof_left -= (long)size) < 0)
+        prof_sample(p, size);
+    return p;
+}
+
+#ifdef __cplusplus
+}
+#endif
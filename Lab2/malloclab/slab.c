@@ -0,0 +1,216 @@
+/*
+ * slab.c - small-object allocator layered under mm.c.
+ *
+ * Memory comes in spans of SLAB_SPAN_PAGES pages that mm.c hands out as
+ * ordinary, page-aligned allocated blocks (mm_memalign style, so no page is
+ * lost to alignment). Each page serves a single slot size and starts
+ * with a struct slab_page; the slots follow it, and a bitmap in the header
+ * says which of them are free. Pages are marked in the pagemap, so slab_owns()
+ * can tell a slab object from a boundary-tag block without any header.
+ *
+ *   span block: | page 0 | page 1 | ... | page 15 | span header |
+ *   page:       | struct slab_page | slot | slot | slot | ... |
+ *
+ * Pages with free slots sit on the partial list of their size class. Empty
+ * pages go to a shared pool; once every page of a span is empty and the pool
+ * has other pages left, the whole span is given back to mm.c.
+ *
+ * The caller serializes all calls (mm.c holds heap_lock in thread-safe mode).
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "slab.h"
+#include "pagemap.h"
+
+#define SLAB_PAGE_SIZE PAGEMAP_PAGE
+#define SLAB_CLASSES (SLAB_MAX_SIZE / 8)
+#define SLAB_CLASS(size) ((size) / 8 - 1)
+#define SLAB_MAP_WORDS 8            /* 512 slots, enough for 8-byte slots */
+#define SLAB_HDR_SIZE 96            /* sizeof(struct slab_page), 16-byte aligned */
+#define SLAB_SPAN_SIZE (SLAB_SPAN_PAGES * SLAB_PAGE_SIZE + sizeof(struct slab_span))
+#define SPAN_OF(first) ((struct slab_span *)((char *)(first) + SLAB_SPAN_PAGES * SLAB_PAGE_SIZE))
+#define SPAN_FIRST(span) ((char *)(span) - SLAB_SPAN_PAGES * SLAB_PAGE_SIZE)
+
+#define PAGE_OF(p) ((struct slab_page *)((uintptr_t)(p) & ~(SLAB_PAGE_SIZE - 1)))
+
+struct slab_span {
+    int empty_pages;                /* pages of this span in the pool */
+    unsigned char tag;              /* pagemap value of the pages before */
+};
+
+struct slab_page {
+    struct slab_page *next;         /* partial list or empty pool */
+    struct slab_page *prev;
+    struct slab_span *span;
+    unsigned short size;            /* slot size, 0 while in the pool */
+    unsigned short nslots;
+    unsigned short nfree;
+    unsigned short pad;
+    unsigned long free_map[SLAB_MAP_WORDS];  /* bit set = slot free */
+};
+
+_Static_assert(sizeof(struct slab_page) == SLAB_HDR_SIZE, "slab page header size");
+
+static struct slab_page *partial[SLAB_CLASSES];
+static struct slab_page *pool;      /* empty pages */
+static int pool_pages;
+static void *(*span_alloc_fn)(size_t);
+static void (*span_free_fn)(void *);
+
+static void list_push(struct slab_page **head, struct slab_page *page)
+{
+    page->prev = NULL;
+    page->next = *head;
+    if (*head != NULL)
+        (*head)->prev = page;
+    *head = page;
+}
+
+static void list_remove(struct slab_page **head, struct slab_page *page)
+{
+    if (page->prev != NULL)
+        page->prev->next = page->next;
+    else
+        *head = page->next;
+    if (page->next != NULL)
+        page->next->prev = page->prev;
+}
+
+void slab_init(void *(*span_alloc)(size_t size), void (*span_free)(void *span))
+{
+    memset(partial, 0, sizeof(partial));
+    pool = NULL;
+    pool_pages = 0;
+    span_alloc_fn = span_alloc;
+    span_free_fn = span_free;
+}
+
+/*
+ * slab_grow - take a new span from mm.c and put its pages into the pool.
+ */
+static int slab_grow(void)
+{
+    char *first = span_alloc_fn(SLAB_SPAN_SIZE);
+    struct slab_span *span;
+    int i;
+
+    if (first == NULL)
+        return -1;
+    span = SPAN_OF(first);
+    span->tag = pagemap_get(first);
+    if (pagemap_set(first, SLAB_SPAN_PAGES * SLAB_PAGE_SIZE, PAGEMAP_SLAB) < 0) {
+        span_free_fn(first);
+        return -1;
+    }
+    span->empty_pages = SLAB_SPAN_PAGES;
+    for (i = 0; i < SLAB_SPAN_PAGES; i++) {
+        struct slab_page *page = (struct slab_page *)(first + i * SLAB_PAGE_SIZE);
+        page->span = span;
+        page->size = 0;
+        list_push(&pool, page);
+    }
+    pool_pages += SLAB_SPAN_PAGES;
+    return 0;
+}
+
+/*
+ * slab_release - every page of span is in the pool, give the span back.
+ */
+static void slab_release(struct slab_span *span)
+{
+    char *first = SPAN_FIRST(span);
+    int i;
+
+    for (i = 0; i < SLAB_SPAN_PAGES; i++)
+        list_remove(&pool, (struct slab_page *)(first + i * SLAB_PAGE_SIZE));
+    pool_pages -= SLAB_SPAN_PAGES;
+    pagemap_set(first, SLAB_SPAN_PAGES * SLAB_PAGE_SIZE, span->tag);
+    span_free_fn(first);
+}
+
+/*
+ * slab_page_init - turn an empty page into a page of size-byte slots.
+ */
+static void slab_page_init(struct slab_page *page, size_t size)
+{
+    int n = (SLAB_PAGE_SIZE - SLAB_HDR_SIZE) / size;
+    int i;
+
+    page->size = size;
+    page->nslots = n;
+    page->nfree = n;
+    memset(page->free_map, 0, sizeof(page->free_map));
+    for (i = 0; i < n / 64; i++)
+        page->free_map[i] = ~0UL;
+    if (n % 64)
+        page->free_map[n / 64] = (1UL << (n % 64)) - 1;
+}
+
+/*
+ * slab_alloc - allocate a slot of exactly size bytes (a multiple of 8, at
+ *     most SLAB_MAX_SIZE). Returns NULL when no span can be had.
+ */
+void *slab_alloc(size_t size)
+{
+    struct slab_page **head = &partial[SLAB_CLASS(size)];
+    struct slab_page *page = *head;
+    int i, bit;
+
+    if (page == NULL) {
+        if (pool == NULL && slab_grow() < 0)
+            return NULL;
+        page = pool;
+        list_remove(&pool, page);
+        pool_pages--;
+        page->span->empty_pages--;
+        slab_page_init(page, size);
+        list_push(head, page);
+    }
+
+    for (i = 0; page->free_map[i] == 0; i++)
+        ;
+    bit = __builtin_ctzl(page->free_map[i]);
+    page->free_map[i] &= ~(1UL << bit);
+    if (--page->nfree == 0)
+        list_remove(head, page);
+    return (char *)page + SLAB_HDR_SIZE + (i * 64 + bit) * page->size;
+}
+
+/*
+ * slab_free - give a slot back; empty pages return to the pool.
+ */
+void slab_free(void *p)
+{
+    struct slab_page *page = PAGE_OF(p);
+    struct slab_page **head = &partial[SLAB_CLASS(page->size)];
+    int slot = ((char *)p - (char *)page - SLAB_HDR_SIZE) / page->size;
+
+    page->free_map[slot / 64] |= 1UL << (slot % 64);
+    if (page->nfree++ == 0)
+        list_push(head, page);
+    if (page->nfree == page->nslots) {
+        list_remove(head, page);
+        page->size = 0;
+        list_push(&pool, page);
+        pool_pages++;
+        if (++page->span->empty_pages == SLAB_SPAN_PAGES && pool_pages > SLAB_SPAN_PAGES)
+            slab_release(page->span);
+    }
+}
+
+/*
+ * slab_size - the slot size of the slab object p.
+ */
+size_t slab_size(const void *p)
+{
+    return PAGE_OF(p)->size;
+}
+
+/*
+ * slab_owns - whether p lies in a slab page.
+ */
+int slab_owns(const void *p)
+{
+    return pagemap_get(p) == PAGEMAP_SLAB;
+}
@@ -0,0 +1,25 @@
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * slab - fixed-size slots carved out of 4 KB pages, for small requests.
+ * Slot sizes are multiples of 8 up to SLAB_MAX_SIZE; objects carry no header.
+ * Bigger requests stay on the heap: the page header shares the 4 KB page, so
+ * a 1024-byte class would fit only 3 slots, while a 4-byte tag is <1% there.
+ */
+#define SLAB_MAX_SIZE 256
+#define SLAB_SPAN_PAGES 16  /* pages taken from the heap at once */
+
+/* span_alloc must return at least size bytes, page aligned; span_free gives them back */
+void slab_init(void *(*span_alloc)(size_t size), void (*span_free)(void *span));
+void *slab_alloc(size_t size);
+void slab_free(void *p);
+size_t slab_size(const void *p);
+int slab_owns(const void *p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,293 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+#include <vector>
+#include "mm.h"
+#include "config.h"
+
+/*
+ * replay - replay malloclab .rep traces against mm_malloc/mm_free/mm_realloc
+ * and print a latency histogram for every kind of operation.
+ *
+ * A .rep file has four header lines (suggested heap size, number of ids,
+ * number of ops, weight) followed by one op per line:
+ *     a <id> <bytes>      ptr[id] = mm_malloc(bytes)
+ *     r <id> <bytes>      ptr[id] = mm_realloc(ptr[id], bytes)
+ *     f <id>              mm_free(ptr[id])
+ *
+ * --grow adds a synthetic phase that grows GROW_BUFFERS buffers side by side
+ * with mm_realloc, the pattern of a string builder or a growing vector.
+ */
+
+#define SEED 10000
+#define HIST_BUCKETS 32     /* bucket i counts ops that took [2^i, 2^(i+1)) ns */
+#define GROW_BUFFERS 64
+#define GROW_MAX (64 * 1024)
+#define GROW_STEP_MAX 256
+
+enum { OP_MALLOC, OP_FREE, OP_REALLOC, OP_NUM };
+static const char *op_name[OP_NUM] = {"malloc", "free", "realloc"};
+
+struct latency_hist {
+    unsigned long count[HIST_BUCKETS];
+    unsigned long ops;
+    unsigned long total_ns;
+    unsigned long max_ns;
+};
+
+static struct latency_hist hist[OP_NUM];
+static unsigned long realloc_moves;
+static double peak_util;   /* highest get_utilization() seen in the current phase */
+
+static inline unsigned long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* count one op of ns nanoseconds; called after the timed call returned */
+static void hist_add(int op, unsigned long ns)
+{
+    struct latency_hist *h = &hist[op];
+    int b = ns ? 63 - __builtin_clzl(ns) : 0;
+    double util = get_utilization();
+
+    h->count[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+    h->ops++;
+    h->total_ns += ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+    if (util > peak_util)
+        peak_util = util;
+}
+
+/* upper bound of the bucket that holds the p-th percentile */
+static unsigned long hist_percentile(struct latency_hist *h, double p)
+{
+    unsigned long seen = 0, want = (unsigned long)(h->ops * p);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen > want)
+            return 2UL << b;
+    }
+    return h->max_ns;
+}
+
+static void hist_print()
+{
+    for (int op = 0; op < OP_NUM; op++) {
+        struct latency_hist *h = &hist[op];
+        if (h->ops == 0)
+            continue;
+        printf("%-8s %10lu ops, avg %6.0fns, p50 <%luns, p99 <%luns, max %luns\n",
+            op_name[op], h->ops, (double)h->total_ns / h->ops,
+            hist_percentile(h, 0.50), hist_percentile(h, 0.99), h->max_ns);
+        for (int b = 0; b < HIST_BUCKETS; b++)
+            if (h->count[b])
+                printf("    [%9luns, %9luns) %10lu\n", 1UL << b, 2UL << b, h->count[b]);
+    }
+    if (hist[OP_REALLOC].ops)
+        printf("realloc moved the block %lu times (%.1f%%)\n", realloc_moves,
+            100.0 * realloc_moves / hist[OP_REALLOC].ops);
+}
+
+/* Touch the first and last byte so the replay also checks that the block is usable */
+static void touch(void *p, size_t size)
+{
+    if (p != NULL && size > 0) {
+        ((char *)p)[0] = 1;
+        ((char *)p)[size - 1] = 1;
+    }
+}
+
+/* Replay one .rep file; returns 0 on success */
+int replay_trace(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    int heap_size, num_ids, num_ops, weight;
+    char type;
+    int id, lineno = 4;
+    unsigned long bytes, start, ns;
+
+    if (fp == NULL) {
+        std::cerr << "replay: cannot open " << path << std::endl;
+        return 1;
+    }
+    if (fscanf(fp, "%d %d %d %d", &heap_size, &num_ids, &num_ops, &weight) != 4 || num_ids < 0) {
+        std::cerr << "replay: " << path << ": bad header" << std::endl;
+        fclose(fp);
+        return 1;
+    }
+
+    peak_util = 0;
+    std::vector<void *> ptr(num_ids, (void *)NULL);
+    std::vector<size_t> size(num_ids, 0);
+    int ops = 0;
+    while (fscanf(fp, " %c", &type) == 1) {
+        lineno++;
+        if (fscanf(fp, "%d", &id) != 1 || id < 0 || id >= num_ids) {
+            std::cerr << "replay: " << path << ":" << lineno << ": bad id" << std::endl;
+            fclose(fp);
+            return 1;
+        }
+        switch (type) {
+        case 'a':
+            if (fscanf(fp, "%lu", &bytes) != 1)
+                goto bad_op;
+            start = now_ns();
+            ptr[id] = mm_malloc(bytes);
+            ns = now_ns() - start;
+            hist_add(OP_MALLOC, ns);
+            if (ptr[id] == NULL && bytes) {
+                std::cerr << "replay: " << path << ":" << lineno << ": mm_malloc failed" << std::endl;
+                fclose(fp);
+                return 1;
+            }
+            size[id] = bytes;
+            touch(ptr[id], bytes);
+            break;
+        case 'r':
+            if (fscanf(fp, "%lu", &bytes) != 1)
+                goto bad_op;
+            {
+                void *old = ptr[id];
+                start = now_ns();
+                ptr[id] = mm_realloc(old, bytes);
+                ns = now_ns() - start;
+                hist_add(OP_REALLOC, ns);
+                if (ptr[id] == NULL && bytes) {
+                    std::cerr << "replay: " << path << ":" << lineno << ": mm_realloc failed" << std::endl;
+                    fclose(fp);
+                    return 1;
+                }
+                if (old != NULL && ptr[id] != old)
+                    realloc_moves++;
+            }
+            size[id] = bytes;
+            touch(ptr[id], bytes);
+            break;
+        case 'f':
+            start = now_ns();
+            mm_free(ptr[id]);
+            ns = now_ns() - start;
+            hist_add(OP_FREE, ns);
+            ptr[id] = NULL;
+            break;
+        default:
+            goto bad_op;
+        }
+        ops++;
+    }
+    fclose(fp);
+    if (ops != num_ops)
+        std::cerr << "replay: " << path << ": header says " << num_ops << " ops, found " << ops << std::endl;
+    printf("%s: %d ops, peak utilization %f\n", path, ops, peak_util);
+
+    /* the next trace starts from an empty heap */
+    for (int i = 0; i < num_ids; i++)
+        if (ptr[i] != NULL)
+            mm_free(ptr[i]);
+    return 0;
+
+bad_op:
+    std::cerr << "replay: " << path << ":" << lineno << ": bad op '" << type << "'" << std::endl;
+    fclose(fp);
+    return 1;
+}
+
+/* Grow GROW_BUFFERS buffers round-robin by random steps up to GROW_MAX bytes, then free them */
+int replay_grow()
+{
+    void *buf[GROW_BUFFERS];
+    size_t len[GROW_BUFFERS];
+    unsigned int seed = SEED;
+    unsigned long start, ns;
+    int live = GROW_BUFFERS;
+
+    peak_util = 0;
+
+    for (int i = 0; i < GROW_BUFFERS; i++) {
+        len[i] = 1 + rand_r(&seed) % GROW_STEP_MAX;
+        start = now_ns();
+        buf[i] = mm_malloc(len[i]);
+        hist_add(OP_MALLOC, now_ns() - start);
+        if (buf[i] == NULL)
+            return 1;
+        touch(buf[i], len[i]);
+    }
+    while (live > 0) {
+        for (int i = 0; i < GROW_BUFFERS; i++) {
+            if (buf[i] == NULL)
+                continue;
+            if (len[i] >= GROW_MAX) {
+                start = now_ns();
+                mm_free(buf[i]);
+                hist_add(OP_FREE, now_ns() - start);
+                buf[i] = NULL;
+                live--;
+                continue;
+            }
+            size_t newlen = len[i] + 1 + rand_r(&seed) % GROW_STEP_MAX;
+            start = now_ns();
+            void *p = mm_realloc(buf[i], newlen);
+            ns = now_ns() - start;
+            hist_add(OP_REALLOC, ns);
+            if (p == NULL)
+                return 1;
+            if (p != buf[i])
+                realloc_moves++;
+            buf[i] = p;
+            len[i] = newlen;
+            touch(p, newlen);
+        }
+    }
+    printf("grow: %d buffers up to %d bytes, peak utilization %f\n", GROW_BUFFERS, GROW_MAX, peak_util);
+    return 0;
+}
+
+void usage(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " [--grow] [--mmap-threshold BYTES] [trace.rep ...]" << std::endl;
+    std::cerr << "  --mmap-threshold  passed to mm_set_mmap_threshold() (allocator built with MMAP=1)" << std::endl;
+    std::cerr << "  with no trace given the DEFAULT_TRACEFILES from config.h are read from " TRACEDIR << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const char *default_tracefiles[] = {DEFAULT_TRACEFILES, NULL};
+    std::vector<std::string> traces;
+    int grow = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--grow"))
+            grow = 1;
+        else if (!strcmp(argv[i], "--mmap-threshold") && i + 1 < argc)
+            mm_set_mmap_threshold(strtoul(argv[++i], NULL, 0));
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else
+            traces.push_back(argv[i]);
+    }
+    if (traces.empty())
+        for (int i = 0; default_tracefiles[i] != NULL; i++)
+            traces.push_back(std::string(TRACEDIR) + default_tracefiles[i]);
+
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed.\n");
+        return 1;
+    }
+    for (size_t i = 0; i < traces.size(); i++)
+        if (replay_trace(traces[i].c_str()))
+            return 1;
+    if (grow && replay_grow()) {
+        std::cerr << "replay: grow phase ran out of memory" << std::endl;
+        return 1;
+    }
+    hist_print();
+    return 0;
+}
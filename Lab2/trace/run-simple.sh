@@ -1,12 +1,21 @@
 #! /bin/bash
 
-printf "Usage: bash ./run-simple.sh\n"
+printf "Usage: bash ./run-simple.sh [--size-hdr]\n"
+
+sizehdr=0
+
+while [[ "$#" -gt 0 ]]; do
+    case "$1" in
+        --size-hdr) sizehdr=1; shift ;;
+        *) echo "Unknown parameter passed: $1"; exit 1 ;;
+    esac
+done
 
 TRACEPATH="$PWD/`dirname $0`"
 MALLOCPATH="$TRACEPATH/../malloclab-simple/"
 export LD_LIBRARY_PATH=$MALLOCPATH:$LD_LIBRARY_PATH
 cd $MALLOCPATH; make clean
-make FIRST_FIT=$fitmode $debug
+make SIZE_HDR=$sizehdr
 cd $TRACEPATH
 g++ -g workload.cc -o workload -I$MALLOCPATH -L$MALLOCPATH -lmem -lpthread -std=c++11
 ./workload
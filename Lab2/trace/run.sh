@@ -1,15 +1,57 @@
 #! /bin/bash
 
-printf "Usage: bash ./run.sh <--first-fit|--best-fit> [--debug]\n"
+printf "Usage: bash ./run.sh [--first-fit|--best-fit] [--seg-list] [--tree-fit] [--slab] [--trim] [--mmap] [--align16] [--thread-safe] [--threads N] [--heaps N] [--replay] [--stats] [--check N] [--profile] [--defer] [--policy first|best|addr|next|good] [--policies] [--good-fit K[,S]] [--batch] [--grow] [--preload "CMD"] [--debug]\n"
 
 
-fitmode=$1
+fitmode=0
+seglist=0
+treefit=0
+slab=0
+trim=0
+mmap=0
+align16=0
+threadsafe=0
+threads=1
+heaps=0
+replay=0
+stats=0
+check=0
+heapcheck=0
+profile=0
+defer=0
+policy=""
+policies=0
+goodfit=""
+batch=0
+grow=0
+preload=""
+target=all
 debug="DEBUG=-UDEBUG"
 
 while [[ "$#" -gt 0 ]]; do
     case "$1" in
         --first-fit) fitmode=1; shift ;;
         --best-fit) fitmode=0; shift ;;
+        --seg-list) seglist=1; shift ;;
+        --tree-fit) treefit=1; shift ;;
+        --slab) slab=1; shift ;;
+        --trim) trim=1; shift ;;
+        --mmap) mmap=1; shift ;;
+        --align16) align16=1; shift ;;
+        --thread-safe) threadsafe=1; shift ;;
+        --threads) threads=$2; threadsafe=1; shift 2 ;;
+        --heaps) heaps=$2; threadsafe=1; shift 2 ;;
+        --replay) replay=1; shift ;;
+        --stats) stats=1; shift ;;
+        --check) check=$2; heapcheck=1; shift 2 ;;
+        --profile) profile=1; shift ;;
+        --defer) defer=1; shift ;;
+        --policy) policy=$2; shift 2 ;;
+        --policies) policies=1; shift ;;
+        --good-fit) goodfit=$2; shift 2 ;;
+        --batch) batch=1; shift ;;
+        --grow) grow=1; shift ;;
+        --preload) preload=$2; target=preload; shift 2 ;;
         --debug) debug="DEBUG=-DDEBUG"; shift ;;
         *) echo "Unknown parameter passed: $1"; exit 1 ;;
     esac
@@ -19,7 +61,41 @@ TRACEPATH=$(case "$0" in /*) echo "`dirname $0`" ;; *) echo "$(pwd)/`dirname $0`
 MALLOCPATH="$TRACEPATH/../malloclab/"
 export LD_LIBRARY_PATH=$MALLOCPATH:$LD_LIBRARY_PATH
 cd $MALLOCPATH; make clean
-make FIRST_FIT=$fitmode $debug
+make $target FIRST_FIT=$fitmode SEG_LIST=$seglist TREE_FIT=$treefit SLAB=$slab TRIM=$trim MMAP=$mmap ALIGN16=$align16 THREAD_SAFE=$threadsafe HEAPS=$heaps MM_STATS=$stats HEAP_CHECK=$heapcheck PROFILE=$profile DEFER=$defer $debug
 cd $TRACEPATH
-g++ -g workload.cc -o workload -I$MALLOCPATH -L$MALLOCPATH -lmem -lpthread -std=c++11
-./workload
+if [[ $profile -eq 1 ]]; then
+    # folded stacks of the live heap at exit, e.g. flamegraph.pl heap.folded > heap.svg
+    export MM_PROFILE=$TRACEPATH/heap.folded
+    rdynamic=-rdynamic  # let dladdr() name the functions of workload itself
+fi
+if [[ -n $preload ]]; then
+    # measure - run a command, then print its wall time and peak RSS (VmHWM, polled every 10ms)
+    measure() {
+        local start=$(date +%s.%N) hwm=0 v
+        "$@" >/dev/null &
+        local pid=$!
+        while kill -0 $pid 2>/dev/null; do
+            v=$(awk '/^VmHWM/ {print $2}' /proc/$pid/status 2>/dev/null)
+            [[ -n $v ]] && hwm=$v
+            sleep 0.01
+        done
+        wait $pid
+        awk -v s=$start -v e=$(date +%s.%N) -v m=$hwm 'BEGIN {printf "%.3fs, peak RSS %d KB\n", e - s, m}'
+    }
+    printf "glibc:     "; measure bash -c "exec $preload"
+    printf "malloclab: "; measure env LD_PRELOAD=$MALLOCPATH/libmalloc.so bash -c "exec $preload"
+elif [[ $replay -eq 1 ]]; then
+    g++ -g replay.cc -o replay -I$MALLOCPATH -L$MALLOCPATH -lmem -lpthread -std=c++11
+    ./replay --grow
+else
+    g++ -g $rdynamic workload.cc -o workload -I$MALLOCPATH -L$MALLOCPATH -lmem -lpthread -std=c++11
+    args="--threads $threads"
+    [[ $stats -eq 1 ]] && args="$args --stats"
+    [[ $heapcheck -eq 1 ]] && args="$args --check $check"
+    [[ -n $policy ]] && args="$args --policy $policy"
+    [[ $policies -eq 1 ]] && args="$args --policies"
+    [[ -n $goodfit ]] && args="$args --good-fit $goodfit"
+    [[ $batch -eq 1 ]] && args="$args --batch"
+    [[ $grow -eq 1 ]] && args="$args --grow"
+    ./workload $args
+fi
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <algorithm>
 #include <unistd.h>
+#include <sys/wait.h>
 #include "mm.h"
 // #include "memlib.h"
 // #include "config.h"
@@ -17,6 +18,10 @@
 #define LOOP_NUM 20     //  initial is 20;
 #define SEED 10000
 #define WORKLOAD_TYPE 16
+#define MAX_THREADS 64
+#define GROW_EVERY 10       /* --grow: one string in GROW_EVERY grows per loop */
+#define GROW_MAX 1024       /* up to this many bytes, so workload_read still fits */
+#define GROW_STEP_MAX 64
 #define malloc mm_malloc
 #define free mm_free
 unsigned int workload_size[WORKLOAD_TYPE] = {12, 16, 24, 32, 48, 64, 96, 100, 128, 192, 256, 384 , 500, 512, 768 , 1024};
@@ -27,32 +32,39 @@ extern size_t heap_size ;
 /*A simplified workload storage index*/
 struct workload_base{
     void** addr;
+    unsigned int seed;  /* rand_r() state, every thread has its own */
+    int id;
+    long ops;           /* mm_malloc + mm_free (+ mm_realloc) calls */
+    double secs;        /* time spent in workload_run */
+    double alloc_secs;  /* of that, in workload_insert + workload_grow + workload_delete */
+    /* --batch: the slots to fill, their sizes and the blocks of one batch call */
+    int *slots;
+    size_t *sizes;
+    void **batch;
 };
 
-/*Generation of string with length*/
-char* gen_random_string(int length)
+int verbose = 1;        /* print every loop, only when running one thread */
+int batch = 0;          /* insert and delete with mm_malloc_batch_sizes / mm_free_batch */
+int grow = 0;           /* grow some strings with mm_realloc every loop */
+
+/*Fill string with length - 1 random characters and a '\0'*/
+void fill_random_string(char *string, int length, unsigned int *seed)
 {
 	int flag, i;
-	char* string;
-	if ((string = (char*) malloc(length)) == NULL )
-	{
-		std::cerr << "Malloc failed at genRandomString!" << std::endl;
-		return NULL ;
-	}
 
 	for (i = 0; i < length - 1; i++)
 	{
-		flag = rand() % 3;
+		flag = rand_r(seed) % 3;
 		switch (flag)
 		{
 			case 0:
-				string[i] = 'A' + rand() % 26;
+				string[i] = 'A' + rand_r(seed) % 26;
 				break;
 			case 1:
-				string[i] = 'a' + rand() % 26;
+				string[i] = 'a' + rand_r(seed) % 26;
 				break;
 			case 2:
-				string[i] = '0' + rand() % 10;
+				string[i] = '0' + rand_r(seed) % 10;
 				break;
 			default:
 				string[i] = 'x' ;
@@ -60,35 +72,119 @@ char* gen_random_string(int length)
 		}
 	}
 	string[length - 1] = '\0' ;
-	return string;
 }
 
-/* Create the workload index */
-int workload_create(struct workload_base* workload){
-    srand(SEED);
-    // mem_init();
-    if (mm_init() < 0)
+/*Generation of string with length*/
+char* gen_random_string(int length, unsigned int *seed)
+{
+	char* string;
+	if ((string = (char*) malloc(length)) == NULL )
 	{
-		fprintf(stderr, "mm_init failed.\n");
-		return 0;
+		std::cerr << "Malloc failed at genRandomString!" << std::endl;
+		return NULL ;
 	}
+	fill_random_string(string, length, seed);
+	return string;
+}
+
+/* Create the workload index, mm_init() must have been called */
+int workload_create(struct workload_base* workload, int id){
+    workload->seed = SEED + id;
+    workload->id = id;
+    workload->ops = 0;
+    workload->secs = 0;
+    workload->alloc_secs = 0;
     workload->addr = (void**)malloc(sizeof(void*)*MAX_ITEMS);
+    if (workload->addr == NULL)
+        return 1;
     memset(workload->addr, 0, sizeof(void*)*MAX_ITEMS);
+    if (batch) {
+        /* from new, so that the allocator under test only holds the strings */
+        workload->slots = new int[MAX_ITEMS];
+        workload->sizes = new size_t[MAX_ITEMS];
+        workload->batch = new void*[MAX_ITEMS];
+    }
     return 0;
 }
 
+#ifdef MM_MALLOCLAB
+/* workload_insert with a single mm_malloc_batch_sizes() call */
+int workload_insert_batch(struct workload_base *workload){
+    int n = 0;
+    for(int i=0;i<MAX_ITEMS;i++){
+        if(workload->addr[i] == 0){
+            workload->slots[n] = i;
+            workload->sizes[n++] = workload_size[rand_r(&workload->seed)%WORKLOAD_TYPE];
+        }
+    }
+    if (mm_malloc_batch_sizes(workload->sizes, n, workload->batch) != (size_t)n)
+        std::cerr << "Malloc failed at workload_insert_batch!" << std::endl;
+    for(int k=0;k<n;k++){
+        workload->addr[workload->slots[k]] = workload->batch[k];
+        if (workload->batch[k] != NULL)
+            fill_random_string((char*)workload->batch[k], workload->sizes[k], &workload->seed);
+    }
+    workload->ops += n;
+    return 0;
+}
+
+/* workload_delete with a single mm_free_batch() call */
+int workload_delete_batch(struct workload_base *workload){
+    int n = 0;
+    for(int i=0;i<MAX_ITEMS;i++){
+        if(rand_r(&workload->seed)%5!=0){
+            workload->batch[n++] = workload->addr[i];
+            workload->addr[i]=0;
+        }
+    }
+    mm_free_batch(workload->batch, n);
+    workload->ops += n;
+    return 0;
+}
+#endif
+
 /* Insert strings up to 100% of MAX_ITEMS */
 int workload_insert(struct workload_base *workload){
     unsigned int size, total=0;
+#ifdef MM_MALLOCLAB
+    if (batch)
+        return workload_insert_batch(workload);
+#endif
     for(int i=0;i<MAX_ITEMS;i++){
         if(workload->addr[i] == 0){
-            size= workload_size[rand()%WORKLOAD_TYPE];
-            workload->addr[i] = gen_random_string(size);
+            size= workload_size[rand_r(&workload->seed)%WORKLOAD_TYPE];
+            workload->addr[i] = gen_random_string(size, &workload->seed);
             total += size;
+            workload->ops++;
+        }
+    }
+    return 0;
+}
+
+#ifdef MM_MALLOCLAB
+/* Grow every GROW_EVERY-th string by random steps up to GROW_MAX bytes with
+   mm_realloc, appending characters as a string builder would */
+int workload_grow(struct workload_base *workload){
+    for(int i=0;i<MAX_ITEMS;i+=GROW_EVERY){
+        char *s = (char*)workload->addr[i];
+        size_t len = strlen(s) + 1;
+        while(len < GROW_MAX){
+            size_t newlen = std::min(len + 1 + rand_r(&workload->seed) % GROW_STEP_MAX, (size_t)GROW_MAX);
+            char *p = (char*)mm_realloc(s, newlen);
+            if (p == NULL) {
+                std::cerr << "Realloc failed at workload_grow!" << std::endl;
+                return 1;
+            }
+            fill_random_string(p + len - 1, newlen - len + 1, &workload->seed);
+            s = p;
+            len = newlen;
+            workload->ops++;
         }
+        workload->addr[i] = s;
     }
     return 0;
 }
+#endif
 
 /* Sort strings */
 int workload_swap(struct workload_base *workload){
@@ -105,7 +201,7 @@ int workload_swap(struct workload_base *workload){
 int workload_read(struct workload_base *workload){
     char reader[1025];
     zipf_distribution<int,double> zipf(MAX_ITEMS-1, 0.99);
-    std::mt19937 generator2(SEED);
+    std::mt19937 generator2(SEED + workload->id);
     for(int i=0;i<MAX_ITEMS*10;i++){
         strcpy(reader, (char*)workload->addr[zipf(generator2)]);
     }
@@ -114,30 +210,56 @@ int workload_read(struct workload_base *workload){
 
 /* Randomly delete 80% of strings */
 int workload_delete(struct workload_base *workload){
+#ifdef MM_MALLOCLAB
+    if (batch)
+        return workload_delete_batch(workload);
+#endif
     for(int i=0;i<MAX_ITEMS;i++){
-        if(rand()%5!=0){
+        if(rand_r(&workload->seed)%5!=0){
             free(workload->addr[i]);
             workload->addr[i]=0;
+            workload->ops++;
         }
     }
     return 0;
 }
 
+/* Wall clock time in seconds */
+double seconds(){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
 /* Run workload */
-void* workload_run(void *workload){
+void* workload_run(void *arg){
+    struct workload_base *workload = (struct workload_base*)arg;
     struct timeval cur_time;
+    double before, after, t;
     for(int loop=0; loop<LOOP_NUM; loop++){
         gettimeofday(&cur_time, NULL);
         long sec1=cur_time.tv_sec,usec1=cur_time.tv_usec;
-        workload_insert((struct workload_base*)workload);
-        workload_swap((struct workload_base*)workload);
-        workload_read((struct workload_base*)workload);
-        std::cout<<"before free: "<<get_utilization();
-        workload_delete((struct workload_base*)workload);
-        std::cout<<"; after free: "<<get_utilization()<<std::endl;
+        t = seconds();
+        workload_insert(workload);
+#ifdef MM_MALLOCLAB
+        if (grow)
+            workload_grow(workload);
+#endif
+        workload->alloc_secs += seconds() - t;
+        workload_swap(workload);
+        workload_read(workload);
+        before = get_utilization();
+        t = seconds();
+        workload_delete(workload);
+        workload->alloc_secs += seconds() - t;
+        after = get_utilization();
         gettimeofday(&cur_time, NULL);
         long sec2=cur_time.tv_sec,usec2=cur_time.tv_usec;
-        std::cout<<"time of loop "<< loop <<" : "<<(sec2-sec1)*1000 + (usec2-usec1)/1000 << "ms" << std::endl;        
+        workload->secs += (sec2-sec1) + (usec2-usec1)/1e6;
+        if (verbose) {
+            std::cout<<"before free: "<<before<<"; after free: "<<after<<std::endl;
+            std::cout<<"time of loop "<< loop <<" : "<<(sec2-sec1)*1000 + (usec2-usec1)/1000 << "ms" << std::endl;
+        }
     }
     return NULL;
 }
@@ -158,16 +280,191 @@ void* monitor_run(void *argv){
     fout.close();
 }
 
-int main(){
+#ifdef MM_MALLOCLAB
+/* Print mm_stats(): event counters, then the free block histogram */
+void print_stats(){
+    struct mm_stats st;
+    mm_stats(&st);
+    printf("mallocs %zu, frees %zu, reallocs %zu\n", st.mallocs, st.frees, st.reallocs);
+    printf("fit steps %zu (%.2f per malloc), %zu searches cut short\n",
+        st.fit_steps, st.mallocs ? (double)st.fit_steps / st.mallocs : 0.0, st.fit_cutoffs);
+    printf("splits %zu, coalesces %zu, extend_heap %zu, consolidations %zu\n",
+        st.splits, st.coalesces, st.extends, st.consolidations);
+    printf("free blocks %zu, %zu bytes, largest %zu, external fragmentation %f\n",
+        st.free_blocks, st.free_bytes, st.largest_free, st.ext_frag);
+    for (int i = 0; i < MM_STATS_BINS; i++)
+        if (st.free_hist[i])
+            printf("    [%10lu, %10lu)  %zu\n", 1UL << i, 2UL << i, st.free_hist[i]);
+}
+
+/* mm_set_policy() names, by MM_FIT_* */
+const char *policy_names[MM_FIT_POLICIES] = {"first", "best", "addr", "next", "good"};
+
+int policy_of(const char *name){
+    for (int p = 0; p < MM_FIT_POLICIES; p++)
+        if (!strcmp(name, policy_names[p]))
+            return p;
+    return -1;
+}
+#endif
+
+void usage(const char *prog){
+    std::cerr << "Usage: " << prog << " [--threads N] [--monitor]" << std::endl;
+    std::cerr << "  --threads N  run N workload threads, each on its own index shard" << std::endl;
+    std::cerr << "               (the allocator must be built with THREAD_SAFE=1 for N > 1)" << std::endl;
+    std::cerr << "  --monitor    sample get_utilization() into ./mem_util.csv every second" << std::endl;
+    std::cerr << "  --stats      print mm_stats() at the end (counters need MM_STATS=1)" << std::endl;
+    std::cerr << "  --check N    mm_checkheap() every N allocator calls (needs HEAP_CHECK=1) and at the end" << std::endl;
+    std::cerr << "  --policy P   place blocks by fit policy P: first, best, addr, next or good" << std::endl;
+    std::cerr << "  --policies   run once per fit policy, each in a fresh process, and print a table" << std::endl;
+    std::cerr << "  --good-fit K[,S]  good fit takes the best of K fits, or one at most S bytes too big" << std::endl;
+    std::cerr << "  --batch      insert and delete with one mm_malloc_batch_sizes / mm_free_batch call per loop" << std::endl;
+    std::cerr << "  --grow       also grow every " << GROW_EVERY << "th string to " << GROW_MAX << " bytes with mm_realloc each loop" << std::endl;
+    std::cerr << "  (--stats, --check, the policies, --batch and --grow are ignored with malloclab-simple)" << std::endl;
+}
+
+int main(int argc, char **argv){
     int error;
-    struct workload_base workload;
-    if(error = workload_create(&workload)){
-        std::cerr << "workload creat error:" << error << std::endl;    
-    }         
-    pthread_t monitor_pid; 
-    // pthread_create(&monitor_pid, NULL, monitor_run, NULL);
-    workload_run(&workload);
-    // pthread_cancel(monitor_pid);
+    int nthreads = 1, monitor = 0, stats = 0;
+    int policy = -1, policies = 0, row = 0;
+    int good_depth = -1;
+    size_t good_slack = 0;
+    unsigned long check = 0;
+    struct timeval cur_time;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            nthreads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--monitor")) {
+            monitor = 1;
+        } else if (!strcmp(argv[i], "--stats")) {
+            stats = 1;
+        } else if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+            check = strtoul(argv[++i], NULL, 0);
+#ifdef MM_MALLOCLAB
+        } else if (!strcmp(argv[i], "--policy") && i + 1 < argc) {
+            if ((policy = policy_of(argv[++i])) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--policies")) {
+            policies = 1;
+        } else if (!strcmp(argv[i], "--good-fit") && i + 1 < argc) {
+            char *end;
+            good_depth = (int)strtol(argv[++i], &end, 0);
+            good_slack = *end == ',' ? strtoul(end + 1, NULL, 0) : 0;
+        } else if (!strcmp(argv[i], "--batch")) {
+            batch = 1;
+        } else if (!strcmp(argv[i], "--grow")) {
+            grow = 1;
+#endif
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+        std::cerr << "--threads must be between 1 and " << MAX_THREADS << std::endl;
+        return 1;
+    }
+#ifdef MM_MALLOCLAB
+    if (policies) {
+        /* one child per policy, so that each one starts from an empty heap */
+        printf("%-8s %12s %12s %16s\n", "policy", "ops/sec", "utilization", "fit steps/malloc");
+        fflush(stdout);
+        for (int p = 0; p < MM_FIT_POLICIES && !row; p++) {
+            int status;
+            pid_t child = fork();
+            if (child == 0) {
+                policy = p;
+                row = 1;
+            } else if (child < 0 || waitpid(child, &status, 0) < 0 ||
+                       !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::cerr << "policy " << policy_names[p] << " failed" << std::endl;
+                return 1;
+            }
+        }
+        if (!row)
+            return 0;
+    }
+#endif
+    verbose = (nthreads == 1 && !row);
+
+    // mem_init();
+    if (mm_init() < 0)
+	{
+		fprintf(stderr, "mm_init failed.\n");
+		return 1;
+	}
+#ifdef MM_MALLOCLAB
+    mm_set_check(2, check);
+    if (policy >= 0)
+        mm_set_policy(policy);
+    if (good_depth >= 0)
+        mm_set_good_fit(good_depth, good_slack);
+#endif
+
+    struct workload_base workload[MAX_THREADS];
+    pthread_t pid[MAX_THREADS];
+    for (int i = 0; i < nthreads; i++) {
+        if(error = workload_create(&workload[i], i)){
+            std::cerr << "workload creat error:" << error << std::endl;
+            return 1;
+        }
+    }
+
+    pthread_t monitor_pid;
+    if (monitor)
+        pthread_create(&monitor_pid, NULL, monitor_run, NULL);
+
+    gettimeofday(&cur_time, NULL);
+    double start = cur_time.tv_sec + cur_time.tv_usec / 1e6;
+    if (nthreads == 1) {
+        workload_run(&workload[0]);
+    } else {
+        for (int i = 0; i < nthreads; i++)
+            pthread_create(&pid[i], NULL, workload_run, &workload[i]);
+        for (int i = 0; i < nthreads; i++)
+            pthread_join(pid[i], NULL);
+    }
+    gettimeofday(&cur_time, NULL);
+    double wall = cur_time.tv_sec + cur_time.tv_usec / 1e6 - start;
+
+    if (monitor)
+        pthread_cancel(monitor_pid);
+
+    /* ops/sec counts mm_malloc + mm_free (+ mm_realloc) calls, time includes the whole loop */
+    long total_ops = 0;
+    for (int i = 0; i < nthreads; i++)
+        total_ops += workload[i].ops;
+#ifdef MM_MALLOCLAB
+    if (row) {
+        struct mm_stats st;
+        mm_stats(&st);
+        printf("%-8s %12.0f %12f %16.2f\n", policy_names[policy], total_ops / wall,
+            get_utilization(), st.mallocs ? (double)st.fit_steps / st.mallocs : 0.0);
+        return 0;
+    }
+#endif
+    for (int i = 0; i < nthreads; i++) {
+        printf("thread %2d: %ld ops in %.3fs, %.0f ops/sec; %s %.3fs, %.0f ops/sec\n", i,
+            workload[i].ops, workload[i].secs, workload[i].ops / workload[i].secs,
+            grow ? "insert + grow + delete" : "insert + delete",
+            workload[i].alloc_secs, workload[i].ops / workload[i].alloc_secs);
+    }
+    printf("total: %d threads, %ld ops in %.3fs, %.0f ops/sec, utilization %f\n",
+        nthreads, total_ops, wall, total_ops / wall, get_utilization());
+#ifdef MM_MALLOCLAB
+    printf("returned to the OS: %zu KB trimmed, %zu KB released\n",
+        trimmed_size >> 10, released_size >> 10);
+    if (stats)
+        print_stats();
+    if (check) {
+        if (mm_checkheap(2) < 0)
+            return 1;
+        printf("heap check: ok\n");
+    }
+#endif
     return 0;
 }
 
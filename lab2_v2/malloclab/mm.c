@@ -83,6 +83,13 @@ static void delete_from_free_list(void *bp);
 double get_utilization();
 void mm_check(const char * function, char* bp);
 
+/* mm_check only prints with DEBUG (make DEBUG=-DDEBUG); otherwise its calls compile away */
+#ifdef DEBUG
+#define MM_CHECK(bp) mm_check(__FUNCTION__, (bp))
+#else
+#define MM_CHECK(bp) ((void)0)
+#endif
+
 /*
     TODO:
         完成一个简单的分配器内存使用率统计
@@ -143,10 +150,10 @@ void *mm_malloc(size_t size)
     if ((bp = find_fit_first(newsize)) != NULL)
     {
         // printf("\n******** BEFORE place():");     // debug
-        mm_check(__FUNCTION__, bp);
+        MM_CHECK(bp);
         place(bp, newsize);
         // printf("\n******** AFTER place():");     // debug
-        mm_check(__FUNCTION__, bp);             // debug
+        MM_CHECK(bp);             // debug
         
         return bp;
     }
@@ -166,7 +173,7 @@ void *mm_malloc(size_t size)
     }
     place(bp, newsize);
     // printf("\nAFTER place():");
-    mm_check(__FUNCTION__, bp);
+    MM_CHECK(bp);
 
     return bp;
 }
@@ -191,7 +198,7 @@ void mm_free(void *bp)
      /*notify next_block, i am free*/
     head_next_bp = HDRP(NEXT_BLKP(bp));
     PUT(head_next_bp, PACK_PREV_ALLOC(GET(head_next_bp), 0));
-    mm_check(__FUNCTION__, bp);
+    MM_CHECK(bp);
 
     coalesce(bp);
 }
@@ -301,7 +308,7 @@ static void *coalesce(void *bp)
         PUT(FTRP(bp), PACK(size, prev_alloc, 0));   // 尾部
         add_to_free_list(bp);
     }
-    mm_check(__FUNCTION__, bp);
+    MM_CHECK(bp);
     return bp;
 }
 
@@ -402,7 +409,7 @@ static void place(void *bp, size_t asize)
         add_to_free_list(free_bp);
         user_malloc_size += asize - WSIZE; // user space need minus header
     }
-   mm_check(__FUNCTION__, bp);
+   MM_CHECK(bp);
 }
 
 static void add_to_free_list(void *bp)